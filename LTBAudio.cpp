@@ -0,0 +1,412 @@
+/*!
+* \file LTBAudio.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* Fixed point spectrum analysis of a sample ring, and actions driven by it
+*/
+
+#include "LTBAudio.h"
+
+// quarter wave, sin(2 pi i / 256) in Q15, i = 0..64
+static const int16_t sinTab[65] PROGMEM = {
+	0, 804, 1608, 2410, 3212, 4011, 4808, 5602,
+	6393, 7179, 7962, 8739, 9512, 10278, 11039, 11793,
+	12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+	18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+	23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+	27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+	30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+	32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+	32767
+};
+
+/**  sin(2 pi t / 256) in Q15 **/
+static inline int16_t
+sin15(uint8_t t)
+{
+	uint8_t q = t & 0x7f;
+	int16_t s = (int16_t)pgm_read_word(sinTab + (q <= 64 ? q : 128 - q));
+
+	return t & 0x80 ? -s : s;
+}
+
+static inline uint8_t
+revBits(uint8_t i, uint8_t bits)
+{
+	uint8_t r = 0;
+
+	while (bits--)
+	{
+		r = (r << 1) | (i & 1);
+		i >>= 1;
+	}
+	return r;
+}
+
+/**  16 * log2(v), 4 bits of fraction from the bits under the top one **/
+static uint16_t
+logMag(uint32_t v)
+{
+	uint8_t b = 0;
+
+	if (v == 0)
+		return 0;
+	while (v >> (b + 1))
+		b++;
+	return b * 16 + (b >= 4 ? (v >> (b - 4)) & 15 : (v << (4 - b)) & 15);
+}
+
+
+audioPat::audioPat(uint16_t npix, uint8_t l2, uint8_t nbands, RGB *pal, uint8_t npal, uint8_t onlvl) :Pattern(onlvl)
+{
+	color = npal ? pal : NULL;					// an empty palette draws the hue wheel
+	numPix = npal;
+	numReps = npix;
+
+	if (l2 < AUDIO_MINLOG2)
+		l2 = AUDIO_MINLOG2;
+	if (l2 > AUDIO_MAXLOG2)
+		l2 = AUDIO_MAXLOG2;
+	log2n = l2;
+	uint16_t n = 1 << l2, half = n >> 1;
+	mask = n - 1;
+
+	if (nbands > AUDIO_MAXBANDS)
+		nbands = AUDIO_MAXBANDS;
+	if (nbands > half - 1)
+		nbands = half - 1;
+	if (nbands == 0)
+		nbands = 1;
+	nb = nbands;
+
+	uint8_t *blk = new uint8_t[nb * 4 + n * 6 + nb * 2 + 1];	// one block, 4 byte sums first
+	sum = (uint32_t *)blk;
+	ring = (int16_t *)(blk + nb * 4);
+	re = (int16_t *)(blk + nb * 4 + n * 2);
+	im = (int16_t *)(blk + nb * 4 + n * 4);
+	edge = blk + nb * 4 + n * 6;
+	lvl = edge + nb + 1;
+
+	/**  log spaced bands over bins 1..n/2, 2^x taken as linear between octaves **/
+	edge[0] = 1;
+	for (uint8_t b = 1; b < nb; b++)
+	{
+		uint16_t x = ((uint16_t)(l2 - 1) * b << 8) / nb;		// octave, 8.8
+		uint16_t e = ((((uint32_t)256 + (x & 0xff)) << (x >> 8)) + 128) >> 8;
+		if (e <= edge[b - 1])
+			e = edge[b - 1] + 1;
+		if (e > half - (nb - b))
+			e = half - (nb - b);
+		edge[b] = e;
+	}
+	edge[nb] = half;
+
+	for (uint16_t i = 0; i < n; i++)
+		ring[i] = 0;
+	for (uint8_t b = 0; b < nb; b++)
+	{
+		sum[b] = 0;
+		lvl[b] = 0;
+	}
+	wr = 0;
+	stage = 0;
+	pos = 0;
+	band = 0;
+	windows = 0;
+	decRem = 0;
+	budget = AUDIO_BUDGET;
+	setRange(32, 176);							// magnitude 4 up 11 octaves, about 66 dB; full scale is 208
+	setDecay(384);
+}
+
+audioPat::~audioPat()
+{
+	delete[](uint8_t *)sum;
+	numReps = 0;
+}
+
+void
+audioPat::memUsage(LTBMem &m)
+{
+	m.patterns += sizeof(*this);
+	m.buffers += (size_t)nb * 6 + ((size_t)6 << log2n) + 1;	// the analysis block, the palette is the caller's
+	Pattern::memUsage(m);
+}
+
+void
+audioPat::push(const int16_t *s, uint16_t n)
+{
+	while (n--)
+		push(*s++);
+}
+
+/**
+**  This function copies the newest window out of the ring, Hann windowed, into the
+**  work arrays in bit reversed order.  Halved on the way in so the complex values can
+**  never grow past 16 bits through the passes.
+**/
+void
+audioPat::load()
+{
+	uint8_t at = wr;							// oldest sample
+	uint16_t n = (uint16_t)mask + 1;
+
+	for (uint16_t i = 0; i < n; i++)
+	{
+		int16_t s = sin15((i << 7) >> log2n);	// sin(pi i / n)
+		int16_t w = ((int32_t)s * s) >> 15;		// Hann, sin^2
+		uint8_t j = revBits(i, log2n);
+
+		re[j] = ((int32_t)ring[(at + i) & mask] * w) >> 16;
+		im[j] = 0;
+	}
+}
+
+/**
+**  This function does butterfly i of pass s (1..log2n), halving both outputs.
+**/
+void
+audioPat::butterfly(uint8_t s, uint8_t i)
+{
+	uint8_t half = 1 << (s - 1);
+	uint8_t j = i & (half - 1);
+	uint8_t top = ((i >> (s - 1)) << s) + j;
+	uint8_t bot = top + half;
+	uint8_t t = (uint16_t)j << (8 - s);			// twiddle angle, 256ths of a turn
+	int16_t wc = sin15(t + 64), ws = sin15(t);
+	int16_t br = re[bot], bi = im[bot];
+	int32_t tr = ((int32_t)br * wc + (int32_t)bi * ws) >> 15;
+	int32_t ti = ((int32_t)bi * wc - (int32_t)br * ws) >> 15;
+	int32_t ar = re[top], ai = im[top];
+
+	re[top] = (ar + tr) >> 1;
+	im[top] = (ai + ti) >> 1;
+	re[bot] = (ar - tr) >> 1;
+	im[bot] = (ai - ti) >> 1;
+}
+
+/**
+**  This function runs the analysis for up to budget units and returns true when it
+**  finishes a window.  The load is one unit per sample and is never split.
+**/
+bool
+audioPat::analyze()
+{
+	uint8_t half = (mask >> 1) + 1;
+	uint16_t used = 0;
+
+	while (budget == 0 || used < budget)
+	{
+		if (stage == 0)
+		{
+			load();
+			used += (uint16_t)mask + 1;
+			stage = 1;
+			pos = 0;
+		}
+		else if (stage <= log2n)
+		{
+			butterfly(stage, pos);
+			used++;
+			if (++pos == half)
+			{
+				stage++;
+				pos = 0;
+				band = 0;
+			}
+		}
+		else
+		{
+			/**  bin pos + 1 into its band, magnitude as max + 3/8 min **/
+			uint8_t k = pos + 1;
+			while (k >= edge[band + 1])
+				band++;
+			int16_t x = re[k], y = im[k];
+			uint16_t ax = x < 0 ? -(int32_t)x : x, ay = y < 0 ? -(int32_t)y : y;
+			sum[band] += ax > ay ? ax + (ay >> 1) - (ay >> 3) : ay + (ax >> 1) - (ax >> 3);
+			used++;
+			if (++pos == half - 1)
+			{
+				stage = 0;
+				pos = 0;
+				windows++;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+**  This function turns the finished sums into levels, raising any that are louder.
+**/
+bool
+audioPat::take()
+{
+	bool changed = false;
+
+	for (uint8_t b = 0; b < nb; b++)
+	{
+		uint16_t v = logMag(sum[b]);
+		uint32_t l = v <= lvlFloor ? 0 : (uint32_t)(v - lvlFloor) * 255 / lvlSpan;
+		sum[b] = 0;
+		if (l > 255)
+			l = 255;
+		if (l > lvl[b])
+		{
+			lvl[b] = l;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+bool
+audioPat::advance(uint16_t deltaT)
+{
+	bool changed = false;
+	uint32_t acc = (uint32_t)decay * deltaT + decRem;
+	uint32_t d = acc / 1000;
+
+	decRem = acc - d * 1000;
+	if (d)
+		for (uint8_t b = 0; b < nb; b++)
+			if (lvl[b])
+			{
+				lvl[b] = lvl[b] > d ? lvl[b] - d : 0;
+				changed = true;
+			}
+
+	if (analyze() && take())
+		changed = true;
+	return changed;
+}
+
+uint8_t *
+audioPat::fillRGB(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillT, p, f, from, n);
+}
+
+
+actionBand::actionBand(audioPat *a, uint8_t b, Pattern *tgt, uint8_t md, uint8_t l, uint8_t h)
+{
+	src = a;
+	band = b;
+	pat = tgt;
+	mode = md;
+	lo = l;
+	hi = h;
+	last = -1;
+	durTime = 0;
+	durTmr = -1;								// never complete
+}
+
+bool
+actionBand::timerTic(unsigned short deltaT)
+{
+	int16_t v = lo + (((int16_t)hi - lo) * src->getLevel(band) + 127) / 255;
+
+	if (v == last)
+		return false;
+	last = v;
+	if (mode == BAND_VAL)
+		static_cast<huePat *>(pat)->setVal(v);
+	else if (mode == BAND_HUE)
+		static_cast<huePat *>(pat)->setHue((uint16_t)v << 8);
+	else
+		pat->setOnLvl(v);
+	return true;
+}
+
+
+#if defined(__linux__)
+static uint32_t
+le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+**  This function opens a RIFF WAVE file and finds its sample data.  Only 16 bit PCM is
+**  taken; chunks other than fmt and data are skipped.
+**/
+bool
+WavIn::open(const char *path)
+{
+	uint8_t h[16];
+	bool fmt = false;
+
+	close();
+	if ((fp = fopen(path, "rb")) == NULL)
+		return false;
+	if (fread(h, 1, 12, fp) != 12 || memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4))
+	{
+		close();
+		return false;
+	}
+
+	while (fread(h, 1, 8, fp) == 8)
+	{
+		uint32_t len = le32(h + 4);
+
+		if (memcmp(h, "fmt ", 4) == 0 && len >= 16)
+		{
+			if (fread(h, 1, 16, fp) != 16 || h[0] != 1 || h[1] != 0 || h[14] != 16 || h[15] != 0)
+				break;							// not PCM, or not 16 bit
+			chans = h[2] | (h[3] << 8);
+			rate = le32(h + 4);
+			fmt = chans != 0 && rate != 0;
+			len -= 16;
+		}
+		else if (memcmp(h, "data", 4) == 0 && fmt)
+		{
+			left = len;
+			rem = 0;
+			return true;
+		}
+		if (fseek(fp, len + (len & 1), SEEK_CUR) != 0)	// chunks are padded to even
+			break;
+	}
+	close();
+	return false;
+}
+
+void
+WavIn::close()
+{
+	if (fp)
+		fclose(fp);
+	fp = NULL;
+	left = 0;
+}
+
+bool
+WavIn::feed(audioPat *a, uint16_t msec)
+{
+	uint32_t acc = rate * msec + rem;
+	uint32_t n = acc / 1000;
+	uint8_t s[2];
+
+	rem = acc - n * 1000;
+	while (n--)
+	{
+		int32_t mix = 0;
+
+		for (uint16_t c = 0; c < chans; c++)
+		{
+			if (left < 2 || fread(s, 1, 2, fp) != 2)
+			{
+				left = 0;
+				return false;
+			}
+			left -= 2;
+			mix += (int16_t)(s[0] | (s[1] << 8));
+		}
+		a->push(mix / chans);
+	}
+	return true;
+}
+#endif
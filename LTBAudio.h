@@ -0,0 +1,208 @@
+// LTBAudio.h
+
+#ifndef _LTBAUDIO_h
+#define _LTBAUDIO_h
+
+#include "LTBDots.h"
+#if defined(__linux__)
+#include <stdio.h>
+#endif
+
+#define AUDIO_MINLOG2	4			// smallest FFT, 16 points
+#define AUDIO_MAXLOG2	8			// largest FFT, 256 points
+#define AUDIO_MAXBANDS	16
+#define AUDIO_BUDGET	128			// default analysis units (samples, butterflies, bins) per advance
+
+#define BAND_LVL		0			// actionBand drives setOnLvl, lo..hi percent
+#define BAND_VAL		1			// drives a huePat's value, lo..hi
+#define BAND_HUE		2			// drives a huePat's hue, lo..hi
+
+/*!
+* \class audioPat
+*
+* \brief spectrum analyser fed from a sample ring, shown as one bar per band
+*
+* Samples (signed, centred on 0) go into a ring of 2^log2n with push, which is safe to
+* call from an ADC interrupt.  advance runs a fixed point FFT on the newest window a
+* budgeted slice at a time, so one analysis spreads over as many frames as it takes:
+* a Hann windowed copy of the ring, then log2n passes of 2^(log2n-1) radix 2 butterflies
+* scaled by half each pass so nothing overflows, then the bins are summed into log
+* spaced bands.  Butterflies and bins keep each frame within setBudget units, but the
+* copy is 2^log2n units in the one frame that starts an analysis, however small the
+* budget: the ring keeps filling behind it, so split across frames the window would not
+* be one stretch of time.  A 256 point FFT costs 256 units in that frame.
+* Band levels are 16 * log2 of the summed magnitude mapped through setRange onto 0-255;
+* they jump up at once and fall back at setDecay per second.
+*
+* The pattern itself draws numReps pixels as nbands bars in palette colors (hue wheel
+* if pal is NULL or npal 0).  To drive other patterns use actionBand.  Animate with
+* animate(), and add it ahead of the patterns it drives so their actions see this
+* frame's levels.
+* Costs 6 bytes per FFT point and 6 per band, in one block; see cost().
+*
+* \author Kevin Wilson
+* \date
+*/
+class audioPat :public Pattern
+{
+public:
+	audioPat(uint16_t npix, uint8_t log2n, uint8_t nbands, RGB *pal, uint8_t npal, uint8_t onlvl);
+	~audioPat();
+
+	inline void		push(int16_t s) { ring[wr] = s; wr = (wr + 1) & mask; };
+	void			push(const int16_t *s, uint16_t n);
+	inline void		setBudget(uint16_t units) { budget = units; };		// 0, a whole analysis per advance; the copy is never split
+	inline void		setRange(uint16_t fl, uint16_t sp) { lvlFloor = fl; lvlSpan = sp ? sp : 1; };
+	inline void		setDecay(uint16_t perSec) { decay = perSec; };
+	inline uint8_t	numBands() { return nb; };
+	inline uint8_t	getLevel(uint8_t b) { return b < nb ? lvl[b] : 0; };
+	inline uint8_t	bandBin(uint8_t b) { return edge[b]; };	// first FFT bin, Hz = bin * rate >> log2n
+	inline uint16_t	getWindows() { return windows; };		// analyses finished
+
+	uint8_t			*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	bool			advance(uint16_t deltaT);
+	void			memUsage(LTBMem &m);
+	static inline size_t	cost(uint8_t log2n, uint8_t nbands)
+	{ return sizeof(audioPat) + ((size_t)6 << log2n) + (size_t)nbands * 6 + 1; };
+
+protected:
+	template <class... P> friend class StaticChain;
+	template <class F> uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n);
+	template <class F> inline uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+	{ return fillT<F>(p, f, from, n); };
+	void			reCalc() {};
+	bool			analyze();
+	void			load();
+	void			butterfly(uint8_t s, uint8_t i);
+	bool			take();
+	audioPat(const audioPat &p);
+
+	uint32_t		*sum;			// magnitude summed per band
+	volatile int16_t	*ring;
+	int16_t			*re;			// FFT work, in place
+	int16_t			*im;
+	uint8_t			*edge;			// first bin of each band, nb + 1 entries
+	uint8_t			*lvl;			// shown level per band
+	volatile uint8_t	wr;			// next ring slot to write, the oldest sample
+	uint8_t			mask;			// ring size - 1
+	uint8_t			log2n;
+	uint8_t			nb;
+	uint8_t			stage;			// 0 load, 1..log2n butterfly pass, log2n + 1 bins
+	uint8_t			pos;			// butterfly or bin within the stage
+	uint8_t			band;			// band the bins are being summed into
+	uint16_t		budget;
+	uint16_t		lvlFloor;		// 16 * log2 magnitude shown as 0
+	uint16_t		lvlSpan;		// and the distance above it shown as 255
+	uint16_t		decay;			// level fall per second
+	uint16_t		decRem;			// decay * msec not yet taken off, in 1/1000ths
+	uint16_t		windows;
+};
+
+/**
+**  This function draws a bar per band, its share of the pixels lit from the start in
+**  proportion to the level, the last lit pixel partly.
+**/
+template <class F> uint8_t *
+audioPat::fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	uint16_t start = 0, to;
+
+	n = fillSpan(numReps, from, n);
+	to = from + n;
+	for (uint8_t b = 0; b < nb && start < to; b++)
+	{
+		uint16_t end = (uint32_t)numReps * (b + 1) / nb;
+		uint16_t len = end - start;
+		int32_t v = lvl[b] ? ((int32_t)lvl[b] + 1) * len : 0;		// lit, 256ths of a pixel
+		RGB c;
+
+		if (end <= from)
+		{
+			start = end;
+			continue;
+		}
+		if (color == NULL)
+			c = hsvRGB((uint16_t)b * 256 / nb, 255, 255);
+		else if (numPix < 2)
+			c = color[0];
+		else
+			c = palRGB(color, numPix, nb > 1 ? (uint16_t)b * 255 / (nb - 1) : 0);
+		c = lvlRGB(c, onLvl);
+
+		uint16_t i0 = start > from ? start : from, i1 = end < to ? end : to;
+		v -= 256 * (int32_t)(i0 - start);						// the part of the bar before from
+		for (uint16_t i = i0; i < i1; i++, v -= 256)
+		{
+			uint8_t o = v <= 0 ? 0 : v > 255 ? 255 : v;
+			uint8_t r = ((uint16_t)c.r * o) >> 8, g = ((uint16_t)c.g * o) >> 8, bl = ((uint16_t)c.b * o) >> 8;
+			f.chanSum += r + g + bl;
+			p = F::put(p, r, g, bl);
+		}
+		start = end;
+	}
+	return p;
+}
+
+/*!
+* \class actionBand
+*
+* \brief runs forever, setting a pattern from one audioPat band
+*
+* BAND_LVL maps the band's 0-255 onto setOnLvl lo..hi; BAND_VAL and BAND_HUE onto a
+* huePat's value or hue, so tgt must be a huePat for those.
+*
+* \author Kevin Wilson
+* \date
+*/
+class actionBand :public Action
+{
+public:
+	actionBand(audioPat *a, uint8_t b, Pattern *tgt, uint8_t md = BAND_LVL, uint8_t l = 0, uint8_t h = 100);
+
+	void			setDimAct(Pattern *pat, uint8_t tgt, ushort dur) {};
+	bool			timerTic(unsigned short deltaT);
+	inline uint8_t	actionType() { return AUDIO; };
+	inline size_t	memSize() { return sizeof(*this); };
+
+protected:
+	audioPat		*src;
+	uint8_t			band;
+	uint8_t			mode;
+	uint8_t			lo;
+	uint8_t			hi;
+	int16_t			last;			// value last set, -1 before the first
+};
+
+#if defined(__linux__)
+/*!
+* \class WavIn
+*
+* \brief 16 bit PCM WAV file as the sample source for an audioPat on a host
+*
+* feed pushes the samples for msec of audio, channels mixed to mono, so a host program
+* calling it once a frame plays the file through the analyser in real time.
+*
+* \author Kevin Wilson
+* \date
+*/
+class WavIn
+{
+public:
+	WavIn() { fp = NULL; rate = 0; chans = 0; left = 0; rem = 0; };
+	~WavIn() { close(); };
+
+	bool			open(const char *path);					// false if not 16 bit PCM
+	void			close();
+	bool			feed(audioPat *a, uint16_t msec);		// false at the end of the data
+	inline uint32_t	getRate() { return rate; };
+
+protected:
+	FILE			*fp;
+	uint32_t		rate;
+	uint16_t		chans;
+	uint32_t		left;			// bytes of sample data not read
+	uint32_t		rem;			// rate * msec not yet pushed, in 1/1000ths
+};
+#endif
+
+#endif
@@ -11,17 +11,77 @@
 #include <pins_arduino.h>
 #endif
 #include <SPI.h>
+#if defined(__AVR__)
+#include <new.h>
+#else
+#include <new>
+#endif
 
-typedef struct  RGB { uint8_t g; uint8_t r; uint8_t b; }RGB;
-typedef struct  iRGB { unsigned g; unsigned r; unsigned b; }iRGB;
+typedef struct  RGB { uint8_t r; uint8_t g; uint8_t b; }RGB;
+typedef struct  iRGB { unsigned r; unsigned g; unsigned b; }iRGB;
 #define ushort unsigned short
 
-#define CLR(r,g,b) ((RGB){b, g, r})
-#define CLRH(h) ((RGB){(h & 0x0000ff)>>8, (h & 0x00ff00)>>16, (h & 0xff0000)})
+#define CLR(r,g,b) ((RGB){r, g, b})
+#define CLRH(h) ((RGB){(uint8_t)((h) >> 16), (uint8_t)((h) >> 8), (uint8_t)(h)})
+
+static inline uint8_t
+qadd8(uint8_t a, uint8_t b)
+{
+	uint16_t t = a + b;
+	return t > 255 ? 255 : t;
+}
+
+/*!
+* \brief wire layout of one pixel, channel order is fixed at compile time
+*
+* BPP is bytes per pixel, HDR the leading byte of 4 byte formats, R/G/B the offsets of
+* each channel within the pixel.  Fill kernels are templates on one of these so there is
+* no per pixel branching on the format.
+*/
+template <uint8_t BPP, uint8_t HDR, uint8_t R, uint8_t G, uint8_t B>
+struct PixFmt
+{
+	enum { bpp = BPP, hdr = HDR };
+
+	static inline uint8_t *put(uint8_t *p, uint8_t r, uint8_t g, uint8_t b)
+	{
+		if (BPP == 4)
+			p[0] = HDR;
+		p[R] = r;
+		p[G] = g;
+		p[B] = b;
+		return p + BPP;
+	}
+	static inline uint8_t *put(uint8_t *p, RGB c) { return put(p, c.r, c.g, c.b); }
+	static inline void add(uint8_t *p, uint8_t r, uint8_t g, uint8_t b)		// saturating
+	{
+		p[R] = qadd8(p[R], r);
+		p[G] = qadd8(p[G], g);
+		p[B] = qadd8(p[B], b);
+	}
+};
+
+#define PIX_APA102	0			// 111bbbbb B G R
+#define PIX_SK9822	1			// same pixel layout as APA102, different end frame
+#define PIX_WS2801	2			// R G B, no header
+
+typedef PixFmt<4, 0xff, 3, 2, 1>	FmtAPA102;
+typedef PixFmt<4, 0xff, 3, 2, 1>	FmtSK9822;
+typedef PixFmt<3, 0, 0, 1, 2>		FmtWS2801;
+
+#define PIX_BPP(f)	((f) == PIX_WS2801 ? 3 : 4)
+
+// calls member template fn<Fmt>(...) for PIX_xxx format fmt
+#define FILL_FMT(fmt, fn, ...) \
+	((fmt) == PIX_WS2801 ? fn<FmtWS2801>(__VA_ARGS__) : \
+	 (fmt) == PIX_SK9822 ? fn<FmtSK9822>(__VA_ARGS__) : fn<FmtAPA102>(__VA_ARGS__))
 
 #define DIMMER 1
 #define ROT_LFT 2
 #define ROT_RGT 3
+#define ANIMATE 4
+#define SCRIPT 5
+#define AUDIO 6
 
 #define SCALE 8
 
@@ -43,11 +103,38 @@ iRGB	RGBStepSz(RGB start, RGB end, int nsteps);
 class Pattern;
 class pixPat;
 class RTPat;
+template <class... P> class StaticChain;
+
+typedef struct LTBMem
+{
+	size_t		strip;			// the LTBDots object
+	size_t		frames;			// dots, the second frame and the cross-fade buffer
+	size_t		dither;			// dither error buffer
+	size_t		patterns;		// heap Pattern objects
+	size_t		buffers;		// buffers owned by patterns: faders, keys, particle pools
+	size_t		actions;		// heap Action objects
+	size_t		arena;			// scene arenas in use, arena patterns/actions are counted here only
+	size_t		total;
+} LTBMem;
+
+/*!
+* \brief running state of one frame fill, handed down through every fillRGB
+*
+* Each LTBDots fills with its own, so strips filled one after another, or on another
+* core or from an ISR, don't share a wire format or add into each other's power estimate.
+*/
+typedef struct LTBFill
+{
+	uint8_t		fmt;			// PIX_xxx of the strip being filled
+	uint32_t	chanSum;		// sum of the channel bytes filled so far
+} LTBFill;
+
+#define FILL_ALL	0xffff		// fillRGB: to the end of the pattern
 
 class Action
 {
 public:
-	Action() { nxt = 0; actionComplete = false; };
+	Action() { nxt = 0; actionComplete = false; inArena = false; };
 
 	virtual ~Action() { nxt = 0; };
 
@@ -55,19 +142,24 @@ public:
 	inline bool				isLast() { return nxt == NULL; };
 	inline bool				isComplete() { return (durTmr == durTime); };
 	inline void				Append(Action *p) { nxt = p; return; };
-	void					deleteNext() { Action *nnxt = nxt->nxt; delete nxt; nxt = nnxt; return; };
+	inline bool				isArena() { return inArena; };
+	inline void				setArena() { inArena = true; };
+	void					deleteNext();
 	virtual uint8_t			actionType() = 0;
 	virtual void			setDimAct(Pattern *pat, uint8_t tgt, ushort dur) = 0;
 	virtual bool			timerTic(unsigned short deltaT) = 0;
+	virtual size_t			memSize() = 0;
 	Action					*nxt;
 protected:
 	Pattern					*pat;				// pattern that is target of action
 	short					durTmr;				// timer for durTime
 	short					durTime;			//  time length of action
 	bool					actionComplete;		// flag if action is done and can be deleted
+	bool					inArena;			// placed in an LTBArena, destroy but don't delete
 };
 
 #define MINTIC 32
+#define LVL_FULL	128			// onLvl of 100%, 1.7 fixed point
 class actionOnLvl :public Action
 {
 public:
@@ -77,6 +169,7 @@ public:
 	void			calcSlopes(Pattern *ptr, uint8_t *start, uint8_t *end, ushort dur);
 	bool			timerTic(unsigned short deltaT);
 	inline uint8_t	actionType() { return DIMMER; };
+	inline size_t	memSize() { return sizeof(*this); };
 
 protected:
 	uint8_t			startLvl;
@@ -85,22 +178,107 @@ protected:
 	Pattern			*pat;
 };
 
+/*!
+* \class actionAnim
+*
+* \brief runs forever, passing elapsed time to Pattern::advance
+*
+* Procedural patterns keep their own time state and speed; this action is their clock.
+*/
+class actionAnim :public Action
+{
+public:
+	actionAnim(Pattern *ptr) { pat = ptr; durTime = 0; durTmr = -1; };	// never complete
+
+	void			setDimAct(Pattern *pat, uint8_t tgt, ushort dur) {};
+	bool			timerTic(unsigned short deltaT);
+	inline uint8_t	actionType() { return ANIMATE; };
+	inline size_t	memSize() { return sizeof(*this); };
+};
+
+/*!
+* \class actionScript
+*
+* \brief effect sequence written as straight line code, run one slice per frame
+*
+* A stackless coroutine (protothread) on the action timeline.  Subclass it and write
+* run() between LTB_BEGIN and LTB_END; LTB_WAIT, LTB_YIELD and LTB_AWAIT hand control
+* back to showLights and pick up at the same spot on a later frame.  Locals don't
+* survive those points, keep state in members.  The whole cost is the object, about
+* 20 bytes on AVR, so hundreds can run at once.
+*
+*	class blink :public actionScript {
+*	public:
+*		blink(Pattern *p) :actionScript(p) {};
+*		bool run() {
+*			LTB_BEGIN();
+*			for (;;) {
+*				pat->dimPat(0, 300);
+*				LTB_AWAIT(!pat->busy());
+*				LTB_WAIT(200);
+*				pat->dimPat(100, 300);
+*				LTB_AWAIT(!pat->busy());
+*			}
+*			LTB_END();
+*		};
+*	};
+*	p->addAct(new blink(p));
+*
+* \author Kevin Wilson
+* \date
+*/
+#define LTB_DONE		0xffff
+#define LTB_BEGIN()		switch (lc) { case 0:
+#define LTB_YIELD()		LTB_YIELD_(__COUNTER__ + 1)
+#define LTB_WAIT(ms)	LTB_WAIT_(ms, __COUNTER__ + 1)
+#define LTB_AWAIT(cond)	LTB_AWAIT_(cond, __COUNTER__ + 1)
+#define LTB_END()		} lc = LTB_DONE; return true
+
+// resume points are numbered with __COUNTER__ so several can share a line
+#define LTB_YIELD_(n)		do { wait = 0; lc = n; return true; case n:; } while (0)
+#define LTB_WAIT_(ms, n)	do { wait += (ms); lc = n; return true; case n:; } while (0)
+#define LTB_AWAIT_(cond, n)	do { wait = 0; lc = n; case n: if (!(cond)) return false; } while (0)
+
+class actionScript :public Action
+{
+public:
+	actionScript(Pattern *ptr) { pat = ptr; lc = 0; wait = 0; durTime = 0; durTmr = -1; };
+
+	void			setDimAct(Pattern *pat, uint8_t tgt, ushort dur) {};
+	bool			timerTic(unsigned short deltaT);
+	inline uint8_t	actionType() { return SCRIPT; };
+	inline bool		done() { return lc == LTB_DONE; };
+	inline size_t	memSize() { return sizeof(*this); };	// override if the script adds members
+
+protected:
+	virtual bool	run() = 0;				// true if it changed something
+
+	uint16_t		lc;						// where run() resumes, LTB_DONE when finished
+	int32_t			wait;					// msec left of LTB_WAIT, below 0 carries the overshoot
+};
+
 
 class Pattern
 {
 public:
-	Pattern() { nxt = 0; acts = 0; };
+	Pattern() { nxt = 0; acts = 0; inArena = false; onLvl = LVL_FULL; };
 	Pattern(uint8_t pct);
 	virtual ~Pattern() { nxt = 0; };//also need to delete the actions list
 
 	inline Pattern			*Nxt() { return nxt; };
 	inline bool				isLast() { return nxt == NULL; };
 	inline void				Append(Pattern *p) { p->nxt = 0; nxt = p; return; };
+	inline bool				isArena() { return inArena; };
+	inline void				setArena() { inArena = true; };
 	bool					doActions(uint16_t deltaT);
 	void					addAct(Action *a);
 	void					dimPat(uint8_t tgt, ushort dur);
+	void					animate();
+	void					unanimate();				// drop the actionAnim, something else advances it
+	virtual bool			advance(uint16_t deltaT) { return false; };	// step procedural state, true if changed
 	void					deleteAct(Action *ptr);
 	void					cleanCompleteActions();
+	bool					busy();						// timed actions (dims) still running
 
 	void					setOnLvl(uint8_t pct);
 	uint8_t					getOnLvl();
@@ -110,6 +288,7 @@ public:
 	virtual void			fillPat(RGB fill, int start = -1, int end = -1) {};
 	void					printPat(char *s);
 	virtual	inline void		setNumPix(uint8_t n) {};
+	inline uint8_t			getNumPix() { return numPix; };
 	inline void				setNumReps(uint16_t n) { numReps = n; };
 	inline void				incNumReps() { numReps++; };
 	inline void				decNumReps() { numReps--; };
@@ -121,19 +300,40 @@ public:
 	virtual	void			stepFader() {};								// update the pixels one fade step
 	virtual	void			clearFader() {};								// delete buffers... requires initFader to fade again
 	virtual	void			resetFader() {};								// restart colors at pre-fade values
-	virtual uint8_t			*fillRGB(uint8_t *p) = 0;
-	virtual	RGB				*getCol(short indx) { if (indx < 0)indx = 0; return color + indx; };
+	virtual uint16_t		pixLen() { return numReps; };		// pixels the pattern fills
+	// pixels from to from + n - 1, cut short at pixLen; err: 2 bytes per pixel, the pixel at p
+	virtual uint8_t			*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL) = 0;
+	virtual uint8_t			*fillRGBDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL) { return fillRGB(p, f, from, n); };
+	virtual	const RGB		*getCol(short indx) { if (indx < 0)indx = 0; return color + indx; };	// read only, may be shared
+	virtual	RGB				*editCol(short indx) { if (indx < 0)indx = 0; return color + indx; };	// writable, see pixPat::editCol
+	virtual void			memUsage(LTBMem &m);		// add this pattern's bytes to m
+
 protected:
 	virtual void			reCalc() = 0;
+	static inline uint16_t	fillSpan(uint16_t len, uint16_t from, uint16_t n)	// n cut to what's left of len
+	{ return from >= len ? 0 : n < len - from ? n : len - from; };
 
 	RGB						*color;			// holds color values to be displayed
 	Pattern					*nxt;
 	Action					*acts;			// holds list of change events
-	uint8_t					onLvl;			// brightness level as %
+	uint8_t					onLvl;			// brightness the fills scale by, LVL_FULL is 100%
 	uint8_t					numPix;
 	uint16_t				numReps;
+	bool					inArena;		// placed in an LTBArena, destroy but don't delete
 };
 
+/************************************************************************/
+/* Destroys a Pattern or Action, freeing it only if it came from new    */
+/************************************************************************/
+template <class T> inline void
+ltbFree(T *p)
+{
+	if (p->isArena())
+		p->~T();
+	else
+		delete p;
+}
+
 class pixPat :public Pattern
 {
 public:
@@ -149,30 +349,91 @@ public:
 	void			rotateRight(uint8_t num = 1);
 
 	inline void		setNumPix(uint8_t n) { numPix = n; };
+	RGB				*editCol(short indx);						// writable; the first takes a heap copy, colorCost
 
-	uint8_t 		*fillRGB(uint8_t *p);
+	uint16_t		pixLen() { return (uint16_t)numPix * numReps; };
+	uint8_t 		*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	uint8_t 		*fillRGBDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
 	void			mergePix(pixPat &p1, uint8_t startPix1, pixPat &p2, uint8_t startPix2);
 	void			initFader(RGB *fadeEnd, short fadeSteps);	// setup to fade pattern to fadeEnd in fadeSteps 
 	void			stepFader();								// update the pixels one fade step
+	void			setFader(ushort step);						// jump the pixels to fade step (0 = start)
 	void			clearFader();								// delete buffers... requires initFader to fade again
 	void			resetFader();								// restart colors at pre-fade values
 	void			fadeNeighbors(RGB prev);					// fades pattern from prev pixPat last pix to next pat first pix
+	pixPat			*clone();									// O(1), shares the colors until either side writes
+	inline bool		isShared() { return refs == NULL || *refs > 1; };
+	void			memUsage(LTBMem &m);
+	static inline size_t	cost(uint8_t np, bool fade = false)	// bytes addPat (and initFader) will take
+	{ return sizeof(pixPat) + (fade ? faderCost(np) : 0); };
+	static inline size_t	faderCost(uint8_t np) { return (size_t)np * 3 * (2 * sizeof(ushort) + sizeof(short)); };
+	static inline size_t	colorCost(uint8_t np) { return sizeof(uint16_t) * (1 + (np * 3 + 1) / 2); };	// a private copy
 
 protected:
+	template <class... P> friend class StaticChain;		// calls fillT directly
+	template <class F> uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n);
+	template <class F> uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n);
 	void	leftRot(uint8_t *p, short n);
 	pixPat(const pixPat &p);
+	void	newColors();						// private, uninitialized color buffer
+	void	ownColors();						// copy on write: call before changing color, takes heap
+	void	releaseColors();
+
+	// color is either the caller's array (refs NULL, never written) or a counted buffer
+	uint16_t *refs;			// patterns sharing the buffer, stored just in front of color
 
 
 	//fader stuff
-	short *current;
-	short *initPix;
+	ushort *current;		// SCALE fixed point, the fraction is used by fillRGBDither
+	ushort *initPix;
 	short *delta;
+	uint8_t	fadePix;		// numPix the fader buffers were sized for
 	iRGB	xstart;
 	iRGB	xdelta;
 
 };
 
 
+/*!
+* \class keyPat
+*
+* \brief plays externally supplied frames, interpolating between them
+*
+* Frames (scene playback, LTBIngest) arrive as keyframes at whatever rate they come.
+* Each new key starts a fader from the colors on show to the key over the key interval,
+* and advance moves the fader by elapsed time with an integer lerp, so showLights can
+* run at the SPI rate and stay smooth with 20-30 keys a second.  Combine with setDither
+* for the fraction.  Fill keyBuf() in place and call commitKey, or use pushKey.
+*
+* \author Kevin Wilson
+* \date
+*/
+#define KEY_STEPS	256				// fader resolution between two keys
+
+class keyPat :public pixPat
+{
+public:
+	keyPat(uint8_t npix, uint16_t nreps = 1, uint8_t onlvl = 100);
+	~keyPat();
+
+	inline RGB		*keyBuf() { return next; };
+	void			commitKey(uint16_t intervalMs = 0);		// 0: use the time since the last key
+	void			pushKey(const RGB *key, uint16_t intervalMs = 0);
+	bool			advance(uint16_t deltaT);
+	void			memUsage(LTBMem &m);
+	static inline size_t	cost(uint8_t np) { return sizeof(keyPat) + colorCost(np) + (size_t)np * sizeof(RGB) + faderCost(np); };
+
+protected:
+	keyPat(const keyPat &p);
+
+	RGB				*next;			// the key being built
+	uint16_t		interval;		// msec from the previous key to this one
+	uint16_t		elapsed;		// msec since this key was committed
+	uint16_t		sinceKey;		// msec since the last commit, for automatic intervals
+	ushort			step;			// fader position, 0..KEY_STEPS
+};
+
+
 class RTPat :public Pattern
 {
 public:
@@ -180,10 +441,23 @@ public:
 	RTPat(RGB *c, uint16_t nReps, uint8_t onlvl);
 	~RTPat() { numReps = 0; };
 
-	uint8_t		*fillRGB(uint8_t *p);
+	uint8_t		*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	uint8_t		*fillRGBDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	void		memUsage(LTBMem &m);
 
 protected:
+	template <class... P> friend class StaticChain;
+	template <class F> uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n);
+	template <class F> uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n);
 	void		reCalc();
+	inline iRGB	rampAt(uint16_t i)		// color of pixel i, wrapping just as i adds of delta do
+	{
+		iRGB c;
+		c.r = start.r + delta.r * i;
+		c.g = start.g + delta.g * i;
+		c.b = start.b + delta.b * i;
+		return c;
+	};
 	RTPat(const RTPat &p);
 
 	iRGB	start;
@@ -194,6 +468,681 @@ protected:
 
 
 
+/*!
+* \class noisePat
+*
+* \brief procedural flicker/flame/plasma from integer value noise
+*
+* Each of numReps pixels samples 2D value noise at (x, z), x stepping by scale along the
+* strip and z moving with time at speed.  The 0-255 noise value picks a color from the
+* palette (numPix entries, interpolated; an empty palette is taken as white).  Pixels
+* are computed straight into dots, so the whole strip costs a few bytes of state.
+* Animate with animate() / actionAnim.
+*
+* \author Kevin Wilson
+* \date
+*/
+class noisePat :public Pattern
+{
+public:
+	noisePat(RGB *pal, uint8_t npal, uint16_t npix, uint16_t scl, uint16_t spd, uint8_t onlvl);
+	~noisePat() { numReps = 0; };
+
+	uint8_t			*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	bool			advance(uint16_t deltaT);
+	inline void		setScale(uint16_t s) { scale = s; };
+	inline void		setSpeed(uint16_t s) { speed = s; };
+	void			setPalette(RGB *pal, uint8_t npal);		// NULL or npal 0: white
+	void			memUsage(LTBMem &m);
+
+protected:
+	template <class... P> friend class StaticChain;
+	template <class F> uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n);
+	template <class F> inline uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+	{ return fillT<F>(p, f, from, n); };
+	void			reCalc() {};
+	noisePat(const noisePat &p);
+
+	uint16_t		scale;			// noise cells per pixel, SCALE fixed point
+	uint16_t		speed;			// noise cells per second, SCALE fixed point
+	uint16_t		z;				// time coordinate, SCALE fixed point
+	uint16_t		zRem;			// speed * msec not yet moved into z, in 1/1000ths
+};
+
+/*!
+* \class sparklePat
+*
+* \brief particles (twinkles, sparks) added over a background Pattern
+*
+* Holds a fixed pool of up to cap particles in one block, one array per field, with the
+* live ones packed at the front.  Each frame the background fills the span and then only
+* the live particles are touched, so the particle cost is O(active) not O(strip).
+* Particles spawn at rate per second at random spots with random speed up to maxVel and
+* a random palette color (white if the palette is empty), and fade out over lifeMs.
+* Animate with animate().
+*
+* \author Kevin Wilson
+* \date
+*/
+class sparklePat :public Pattern
+{
+public:
+	sparklePat(Pattern *back, uint16_t npix, uint8_t cap, RGB *pal, uint8_t npal, uint8_t onlvl);
+	~sparklePat();
+
+	uint16_t		pixLen() { return bg ? bg->pixLen() : numReps; };
+	uint8_t			*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	bool			advance(uint16_t deltaT);
+	void			setSpawn(uint16_t perSec, uint16_t lifeMs, int16_t maxVel = 0);
+	bool			spawn(uint16_t at, int16_t vel, uint8_t clr);		// add one particle now
+	inline uint8_t	numActive() { return nAct; };
+	void			memUsage(LTBMem &m);
+	static inline size_t	cost(uint8_t cap) { return sizeof(sparklePat) + (size_t)cap * 10; };
+
+protected:
+	template <class... P> friend class StaticChain;
+	template <class F> uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n);
+	template <class F> inline uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+	{ return fillT<F>(p, f, from, n); };
+	void			reCalc() {};
+	void			kill(uint8_t i);
+	sparklePat(const sparklePat &p);
+
+	Pattern			*bg;			// background, may be NULL for black
+	uint8_t			cap;			// pool size
+	uint8_t			nAct;			// live particles, packed at the front of the pool
+	uint16_t		*pix;			// position, whole pixels
+	int16_t			*vel;			// speed, SCALE fixed point pixels per second
+	uint16_t		*life;			// remaining brightness, 0xffff at birth
+	int16_t			*rem;			// vel * msec not yet moved, in 1/1000ths of a fraction step
+	uint8_t			*frac;			// position, fraction of a pixel
+	uint8_t			*clr;			// palette index
+	uint16_t		rate;			// spawns per second
+	uint16_t		rateRem;		// rate * msec not yet spawned, in 1/1000ths
+	uint16_t		decay;			// life lost per msec
+	int16_t			maxVel;
+};
+
+/*!
+* \class huePat
+*
+* \brief rainbow of numReps pixels computed from a moving hue offset
+*
+* Pixel i shows hsvRGB((hue + i * step) >> 8, sat, val), with hue and step 8.8 fixed
+* point (step 256 walks the color wheel once every 256 pixels).  advance moves hue by
+* speed per second, so a chase over the whole strip is one 16 bit update per frame.
+* Animate with animate().
+*
+* \author Kevin Wilson
+* \date
+*/
+class huePat :public Pattern
+{
+public:
+	huePat(uint16_t npix, uint16_t stp, int16_t spd, uint8_t s, uint8_t v, uint8_t onlvl);
+	~huePat() { numReps = 0; };
+
+	uint8_t			*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	bool			advance(uint16_t deltaT);
+	inline void		setHue(uint16_t h) { hue = h; };
+	inline uint16_t	getHue() { return hue; };
+	inline void		setStep(uint16_t s) { step = s; };
+	inline void		setSpeed(int16_t s) { speed = s; };
+	inline void		setSatVal(uint8_t s, uint8_t v) { sat = s; val = v; };
+	inline void		setVal(uint8_t v) { val = v; };
+	void			memUsage(LTBMem &m);
+
+protected:
+	template <class... P> friend class StaticChain;
+	template <class F> uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n);
+	template <class F> inline uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+	{ return fillT<F>(p, f, from, n); };
+	void			reCalc() {};
+	huePat(const huePat &p);
+
+	uint16_t		hue;			// hue of the first pixel, 8.8 fixed point
+	uint16_t		step;			// hue added per pixel, 8.8 fixed point
+	int16_t			speed;			// hue per second, 8.8 fixed point, negative runs backwards
+	int16_t			hueRem;			// speed * msec not yet moved into hue, in 1/1000ths
+	uint8_t			sat;
+	uint8_t			val;
+};
+
+RGB		hsvRGB(uint8_t h, uint8_t s, uint8_t v);
+RGB		palRGB(RGB *pal, uint8_t npal, uint8_t v);
+uint8_t	noise8(uint16_t x, uint16_t z);
+
+//
+/*** fill kernels *****/
+//
+// Defined here rather than in LTBLdots.cpp so StaticScene can call them directly
+// for its format and they inline into its fill.
+
+/************************************************************************/
+/* This function converts an iRGB back to an 8 bit RGB                  */
+/************************************************************************/
+static inline RGB
+toRGB(iRGB c)
+{
+	RGB res;
+	res.r = c.r >> SCALE;
+	res.g = c.g >> SCALE;
+	res.b = c.b >> SCALE;
+	return res;
+}
+
+/***************************************************************************/
+/* This function adds 2 iRGBs assuming they were fix point scaled by SCALE */
+/***************************************************************************/
+static inline iRGB
+addiRGB(iRGB c1, iRGB c2)
+{
+	iRGB sum;
+	sum.r = c1.r + c2.r;
+	sum.g = c1.g + c2.g;
+	sum.b = c1.b + c2.b;
+	return sum;
+}
+
+/************************************************************************/
+/* This function blends a toward b by t/256                             */
+/************************************************************************/
+static inline uint8_t
+lerp8(uint8_t a, uint8_t b, uint8_t t)
+{
+	if (b >= a)										// keep the product unsigned 16 bit for AVR
+		return a + (((uint16_t)(b - a) * t) >> 8);
+	return a - (((uint16_t)(a - b) * t) >> 8);
+}
+
+/************************************************************************/
+/* This function hashes a noise lattice point to 0-255                  */
+/************************************************************************/
+static inline uint8_t
+noiseHash(uint8_t x, uint8_t z)
+{
+	uint16_t h = x * 0x9e37u + z * 0x79b9u + 0x3c6eu;
+	h ^= h >> 5;
+	h *= 0x2c1bu;
+	h ^= h >> 8;
+	return (uint8_t)h;
+}
+
+/************************************************************************/
+/* smoothstep on a 0-255 fraction, 3t^2 - 2t^3                          */
+/************************************************************************/
+static inline uint8_t
+fade8(uint8_t t)
+{
+	return ((uint32_t)t * t * (768 - 2 * t)) >> 16;
+}
+
+/************************************************************************/
+/* This function scales a color by an onLvl, LVL_FULL leaves it as is   */
+/************************************************************************/
+static inline RGB
+lvlRGB(RGB c, uint8_t lvl)
+{
+	if (lvl < LVL_FULL)
+	{
+		c.r = ((uint16_t)c.r * lvl) / LVL_FULL;
+		c.g = ((uint16_t)c.g * lvl) / LVL_FULL;
+		c.b = ((uint16_t)c.b * lvl) / LVL_FULL;
+	}
+	return c;
+}
+
+/************************************************************************/
+/* This function repeats the period of len bytes at p until there are   */
+/* total bytes, doubling the copied block each pass.  Returns the end   */
+/************************************************************************/
+static inline uint8_t *
+repeatFill(uint8_t *p, size_t len, size_t total)
+{
+	size_t have = len;
+
+	while (have < total)
+	{
+		size_t n = total - have < have ? total - have : have;
+		memcpy(p + have, p, n);
+		have += n;
+	}
+	return p + total;
+}
+
+/************************************************************************/
+/* This function writes one temporally dithered pixel.  v0..v2 are the  */
+/* channels in memory order, SCALE fixed point, scaled by lvl first.   */
+/* The top 4 bits of the fraction are carried to the next frame in e,   */
+/* giving ~12 bit color                                                 */
+/************************************************************************/
+template <class F> static inline uint8_t *
+ditherPix(uint8_t *p, uint16_t r, uint16_t g, uint16_t b, uint8_t *e, LTBFill &f, uint8_t lvl)
+{
+	if (lvl < LVL_FULL)
+	{
+		r = ((uint32_t)r * lvl) / LVL_FULL;
+		g = ((uint32_t)g * lvl) / LVL_FULL;
+		b = ((uint32_t)b * lvl) / LVL_FULL;
+	}
+	uint16_t tr = (r >> (SCALE - 4)) + (e[0] & 0x0f);
+	uint16_t tg = (g >> (SCALE - 4)) + (e[0] >> 4);
+	uint16_t tb = (b >> (SCALE - 4)) + (e[1] & 0x0f);
+
+	e[0] = (tr & 0x0f) | (tg << 4);
+	e[1] = tb & 0x0f;
+	f.chanSum += (tr >> 4) + (tg >> 4) + (tb >> 4);
+	return F::put(p, tr >> 4, tg >> 4, tb >> 4);
+}
+
+/**
+**  This function fills one period starting at the color pixel from lands on, then
+**  copies of it, so a fill can start and stop anywhere in the pattern.
+**/
+template <class F> uint8_t *
+pixPat::fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	uint32_t sum = 0, part = 0;
+	uint8_t *p0 = p;
+
+	n = fillSpan(pixLen(), from, n);
+	if (n == 0)
+		return p;
+	uint8_t j = from % numPix, m = n < numPix ? n : numPix, rest = n % numPix;
+	for (uint8_t i = 0; i < m; i++)
+	{
+		if (i == rest)
+			part = sum;								// power of the partial period at the end
+		RGB c = lvlRGB(color[j], onLvl);
+		sum += c.r + c.g + c.b;
+		p = F::put(p, c);
+		if (++j == numPix)
+			j = 0;
+	}
+	f.chanSum += n < numPix ? sum : sum * (n / numPix) + part;
+	return repeatFill(p0, p - p0, (size_t)n * F::bpp);
+}
+
+/**
+**  This function dithers the fraction the fader keeps in current.  A pixel written
+**  since the fader last ran (fillPat, a rotate, mergePix) no longer matches it and is
+**  shown from color, without a fraction.
+**/
+template <class F> uint8_t *
+pixPat::fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+{
+	if (current == NULL)
+		return fillT<F>(p, f, from, n);			// no fader running, colors have no fraction
+	n = fillSpan(pixLen(), from, n);
+	if (n == 0)
+		return p;
+	uint8_t j = from % numPix;
+	ushort *c = current + j * 3;
+	uint8_t *b = (uint8_t *)(color + j);
+
+	for (; n; n--, err += 2)
+	{
+		if ((c[0] >> SCALE) == b[0] && (c[1] >> SCALE) == b[1] && (c[2] >> SCALE) == b[2])
+			p = ditherPix<F>(p, c[0], c[1], c[2], err, f, onLvl);
+		else										// written since the fader ran, its fraction is stale
+			p = ditherPix<F>(p, (uint16_t)b[0] << SCALE, (uint16_t)b[1] << SCALE, (uint16_t)b[2] << SCALE, err, f, onLvl);
+		c += 3;
+		b += 3;
+		if (++j == numPix)
+		{
+			j = 0;
+			c = current;
+			b = (uint8_t *)color;
+		}
+	}
+	return p;
+}
+
+template <class F> uint8_t *
+RTPat::fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	iRGB c = rampAt(from);
+	RGB v;
+
+	n = fillSpan(numReps, from, n);
+	for (uint16_t i = 0; i < n; i++)
+	{
+		v = lvlRGB(toRGB(c), onLvl);
+		f.chanSum += v.r + v.g + v.b;
+		p = F::put(p, v);
+		c = addiRGB(c, delta);
+	}
+	return p;
+}
+
+template <class F> uint8_t *
+RTPat::fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+{
+	iRGB c = rampAt(from);
+
+	n = fillSpan(numReps, from, n);
+	for (uint16_t i = 0; i < n; i++, err += 2)
+	{
+		p = ditherPix<F>(p, (uint16_t)c.r, (uint16_t)c.g, (uint16_t)c.b, err, f, onLvl);
+		c = addiRGB(c, delta);
+	}
+	return p;
+}
+
+/**
+**  The time interpolation is the same for every pixel, so the two lattice columns
+**  around x are only recomputed when x crosses into a new cell.
+**/
+template <class F> uint8_t *
+noisePat::fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	uint8_t zi = z >> SCALE, fz = fade8(z & 0xff);
+	uint16_t x = from * scale;
+	uint8_t xi = x >> SCALE, c0, c1;
+	RGB c;
+
+	n = fillSpan(numReps, from, n);
+	c0 = lerp8(noiseHash(xi, zi), noiseHash(xi, zi + 1), fz);
+	c1 = lerp8(noiseHash(xi + 1, zi), noiseHash(xi + 1, zi + 1), fz);
+	for (uint16_t i = 0; i < n; i++, x += scale)
+	{
+		if ((uint8_t)(x >> SCALE) != xi)
+		{
+			xi = x >> SCALE;
+			c0 = lerp8(noiseHash(xi, zi), noiseHash(xi, zi + 1), fz);
+			c1 = lerp8(noiseHash(xi + 1, zi), noiseHash(xi + 1, zi + 1), fz);
+		}
+		c = lvlRGB(palRGB(color, numPix, lerp8(c0, c1, fade8(x & 0xff))), onLvl);
+		f.chanSum += c.r + c.g + c.b;
+		p = F::put(p, c);
+	}
+	return p;
+}
+
+template <class F> uint8_t *
+sparklePat::fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	uint8_t *p0 = p;
+
+	if (bg)
+		p = bg->fillRGB(p, f, from, n);
+	else
+		for (n = fillSpan(numReps, from, n); n; n--)
+			p = F::put(p, 0, 0, 0);
+	n = (p - p0) / F::bpp;					// never draw past what the background covered
+
+	for (uint8_t i = 0; i < nAct; i++)
+	{
+		if (pix[i] < from || pix[i] - from >= n)
+			continue;
+		uint8_t l = life[i] >> 8;
+		RGB c = lvlRGB(color[clr[i]], onLvl);
+		c.r = ((uint16_t)c.r * l) >> 8;
+		c.g = ((uint16_t)c.g * l) >> 8;
+		c.b = ((uint16_t)c.b * l) >> 8;
+		f.chanSum += c.r + c.g + c.b;
+		F::add(p0 + (pix[i] - from) * F::bpp, c.r, c.g, c.b);
+	}
+	return p;
+}
+
+/**
+**  This function fills the rainbow.  Neighbours that land on the same whole hue share
+**  one conversion, so shallow gradients cost little more than a copy.
+**/
+template <class F> uint8_t *
+huePat::fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	uint16_t h = hue + from * step;
+	uint8_t last = h >> 8;
+	RGB c = lvlRGB(hsvRGB(last, sat, val), onLvl);
+
+	n = fillSpan(numReps, from, n);
+	for (uint16_t i = 0; i < n; i++, h += step)
+	{
+		if ((uint8_t)(h >> 8) != last)
+		{
+			last = h >> 8;
+			c = lvlRGB(hsvRGB(last, sat, val), onLvl);
+		}
+		f.chanSum += c.r + c.g + c.b;
+		p = F::put(p, c);
+	}
+	return p;
+}
+
+
+/*!
+* \class StaticChain
+*
+* \brief compile time list of patterns, filled and ticked in order with direct calls
+*
+* Each level holds one typed pattern pointer and calls its fill kernel fillT<F> for the
+* strip's format and H::advance with the class named, so there is no vtable lookup or
+* per pattern format switch and the fills inline.  Members are taken off animate(), as
+* the chain advances them.  Used by StaticScene.
+*
+* \author Kevin Wilson
+* \date
+*/
+template <class... P> class StaticChain;
+
+template <> class StaticChain<>
+{
+public:
+	StaticChain() {};
+
+	inline uint16_t	len() { return 0; };
+	template <class F> inline uint8_t	*fill(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n) { return p; };
+	template <class F> inline uint8_t	*fillDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n) { return p; };
+	inline bool		tick(uint16_t deltaT) { return false; };
+};
+
+template <class H, class... T> class StaticChain<H, T...> :public StaticChain<T...>
+{
+public:
+	StaticChain(H *h, T *... t) :StaticChain<T...>(t...) { head = h; h->unanimate(); };
+
+	inline uint16_t len() { return head->H::pixLen() + StaticChain<T...>::len(); };
+	template <class F> inline uint8_t *fill(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+	{
+		uint16_t hl = head->H::pixLen();
+		if (from >= hl)
+			return StaticChain<T...>::template fill<F>(p, f, from - hl, n);
+		uint8_t *q = head->H::template fillT<F>(p, f, from, n);
+		uint16_t got = (q - p) / F::bpp;
+		return got < n ? StaticChain<T...>::template fill<F>(q, f, 0, n - got) : q;
+	};
+	template <class F> inline uint8_t *fillDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+	{
+		uint16_t hl = head->H::pixLen();
+		if (from >= hl)
+			return StaticChain<T...>::template fillDither<F>(p, err, f, from - hl, n);
+		uint8_t *q = head->H::template fillDitherT<F>(p, err, f, from, n);
+		uint16_t got = (q - p) / F::bpp;
+		return got < n ? StaticChain<T...>::template fillDither<F>(q, err + got * 2, f, 0, n - got) : q;
+	};
+	inline bool tick(uint16_t deltaT)
+	{
+		bool changed = head->doActions(deltaT);
+		if (head->H::advance(deltaT))
+			changed = true;
+		return StaticChain<T...>::tick(deltaT) || changed;
+	};
+
+protected:
+	H				*head;
+};
+
+/*!
+* \class StaticScene
+*
+* \brief a fixed set of patterns whose types are known at compile time
+*
+* StaticScene<pixPat, huePat, sparklePat> scene(&a, &b, &c) renders a, b and c in order
+* as one Pattern: the strip makes one virtual call per frame for the scene, the scene
+* picks the kernels for the strip's format once and fills and advances its members
+* through direct calls.  Members belong to the caller (globals are typical) and are
+* advanced by the scene; the scene takes them off animate() so they step once a frame.
+* A StaticScene can itself be a member of another.  Each member is drawn at its own
+* onLvl; the scene's is not applied, so dim the members.
+* Add the scene with addPat(new StaticScene<...>(...)) or place it in an arena.
+*
+* \author Kevin Wilson
+* \date
+*/
+template <class... P> class StaticScene :public Pattern
+{
+public:
+	StaticScene(P *... p) :Pattern(100), chain(p...) { color = NULL; numPix = 0; numReps = 0; animate(); };
+
+	uint16_t		pixLen() { return chain.len(); };
+	uint8_t			*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL)
+	{ return FILL_FMT(f.fmt, fillT, p, f, from, n); };
+	uint8_t			*fillRGBDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL)
+	{ return FILL_FMT(f.fmt, fillDitherT, p, err, f, from, n); };
+	bool			advance(uint16_t deltaT) { return chain.tick(deltaT); };
+	void			memUsage(LTBMem &m) { m.patterns += sizeof(*this); Pattern::memUsage(m); };
+
+protected:
+	template <class... Q> friend class StaticChain;
+	template <class F> inline uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+	{ return chain.template fill<F>(p, f, from, n); };
+	template <class F> inline uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+	{ return chain.template fillDither<F>(p, err, f, from, n); };
+	void			reCalc() {};
+
+	StaticChain<P...> chain;
+};
+
+
+/*!
+* \class LTBArena
+*
+* \brief bump allocator over a caller supplied buffer
+*
+* Used by loadScene to place Patterns, Actions and palettes without touching the heap.
+* Nothing is freed individually; reset releases everything at once.
+*
+* \author Kevin Wilson
+* \date
+*/
+class LTBArena
+{
+public:
+	LTBArena() { base = top = end = NULL; };
+
+	inline void		init(uint8_t *buf, size_t sz) { base = top = buf; end = buf + sz; };
+	inline void		reset() { top = base; };
+	inline size_t	used() { return top - base; };
+	void			*alloc(size_t n);
+
+protected:
+	uint8_t			*base;
+	uint8_t			*top;
+	uint8_t			*end;
+};
+
+
+/*!
+* \class DotsOut
+*
+* \brief output stage that clocks a frame (leader, dots, trailer) out to the strip
+*
+* LTBDots hands each frame to its DotsOut as a sequence of write/zeros calls followed
+* by endFrame.  Buffers passed to write must stay valid until endFrame returns, which
+* lets backends queue them and push the whole frame in one go.
+*
+* \author Kevin Wilson
+* \date
+*/
+class DotsOut
+{
+public:
+	virtual ~DotsOut() {};
+
+	virtual void			write(const uint8_t *p, size_t n) = 0;	// queue n bytes of frame data
+	virtual void			zeros(size_t n) = 0;					// queue n zero bytes (leader/trailer)
+	virtual void			endFrame() {};							// push out everything queued so far
+};
+
+class SPIOut :public DotsOut
+{
+public:
+	void			write(const uint8_t *p, size_t n);
+	void			zeros(size_t n);
+};
+
+extern SPIOut	spiOut;			// default output, Arduino SPI library
+
+
+/*!
+* \class DotsClock
+*
+* \brief time source for LTBDots, in msec
+*
+* millisClock reads millis().  ManualClock only moves when told to, so a host program can
+* drive any number of frames as fast as it likes and get the same output every run.
+*
+* \author Kevin Wilson
+* \date
+*/
+class DotsClock
+{
+public:
+	virtual ~DotsClock() {};
+
+	virtual uint32_t		now() = 0;
+};
+
+class MillisClock :public DotsClock
+{
+public:
+	uint32_t		now();
+};
+
+class ManualClock :public DotsClock
+{
+public:
+	ManualClock() { ms = 0; };
+
+	uint32_t		now() { return ms; };
+	inline void		set(uint32_t t) { ms = t; };
+	inline void		tick(uint32_t dt) { ms += dt; };
+
+protected:
+	uint32_t		ms;
+};
+
+extern MillisClock	millisClock;	// default clock
+
+
+typedef struct LTBStats
+{
+	uint32_t	rendered;		// frames filled by renderFrame
+	uint32_t	sent;			// new frames sent by sendFrame
+	uint32_t	dropped;		// rendered frames overwritten before they were sent
+	uint32_t	repeated;		// sendFrame calls that resent the previous frame
+	uint32_t	skipped;		// sends dropped by setFrameSkip because nothing on the strip would change
+} LTBStats;
+
+#define MA_PER_CHAN	20			// default mA drawn by one channel at 255
+#define MA_IDLE		1			// default mA drawn by one dark pixel
+
+#define TIME_1X		256			// setSpeed: 8.8 fixed point multiplier
+#define TIME_MAXSTEPS	8			// setTimestep: most fixed steps run to catch up in one frame
+
+#define RS_IDLE		0			// showStep: between frames
+#define RS_FILL		1			// showStep: filling patterns into the back frame
+#define RS_SEND		2			// showStep: frame filled, leader not sent yet
+#define RS_SENDING	3			// showStep: sending pixels from dp
+#define RS_XFILL	4			// showStep: filling a cross-fade's incoming scene into xBuf
+#define RS_BLEND	5			// showStep: blending xBuf into the back frame
+#define RS_CHUNK	32			// showStep: pixels of work per slice when only a time limit is set
+
+#define DB_FRONT	0x01		// bufState: index of the frame being transmitted
+#define DB_READY	0x02		// bufState: back frame is complete and waiting to be sent
+
 /*!
 * \class LTBDots
 *
@@ -222,28 +1171,129 @@ public:
 	* \note [any note about the function you might have]
 	* \warning [any warning if necessary]
 	*/
-	LTBDots(short n);
-	Pattern		*addPat(RGB *pix, uint8_t np, uint8_t nr, uint8_t onlvl = 100);
+	LTBDots(uint16_t n, uint8_t fmt = PIX_APA102);
+	Pattern		*addPat(RGB *pix, uint8_t np, uint16_t nr, uint8_t onlvl = 100);
+	void		addPat(Pattern *pat);						// append a Pattern made with new, the strip deletes it
 	Pattern		*addTrans(RGB *pix, short nr, uint8_t onlvl = 100);
+	Pattern		*addNoise(RGB *pal, uint8_t npal, uint16_t npix, uint16_t scale, uint16_t speed, uint8_t onlvl = 100);
+	keyPat		*addKeys(uint8_t npix, uint16_t nreps = 1, uint8_t onlvl = 100);
+	Pattern		*addHue(uint16_t npix, uint16_t step, int16_t speed, uint8_t sat = 255, uint8_t val = 255, uint8_t onlvl = 100);
+	Pattern		*addSparkle(Pattern *bg, uint16_t npix, uint8_t cap, RGB *pal, uint8_t npal, uint8_t onlvl = 100);
 	void		printStrip(char *title, bool dotsOnly=false);
 	void		setOnLvl(uint8_t pct);
 	void		showLights(bool force = false);
+	bool		showStep(uint16_t maxPix, uint16_t maxUsec = 0, bool force = false);	// true when a frame completes
+	inline uint8_t	getPixelFormat() { return pixFmt; };
+	bool		enableDoubleBuffer();
+	bool		setDither(bool on);
+	bool		setFrameSkip(bool on, uint16_t keepaliveMs = 1000);	// false, and off, for keepaliveMs 0
+	uint8_t		getSkipPct();								// share of sends skipped since clearStats
+	void		setPowerBudget(uint16_t mA, uint8_t mAChan = MA_PER_CHAN, uint8_t mAIdle = MA_IDLE);
+	inline uint32_t	getPowerEst() { return powerEst; };			// mA of the last frame at full brightness
+	inline uint8_t	getPowerScale() { return powerScale; };		// APA102 brightness applied, 31 = none
+	bool		renderFrame(bool force = false);
+	bool		sendFrame();
+	uint8_t		*claimFrame();
+	void		publishFrame(size_t len);
+	void		publishFrame(size_t len, uint32_t chanSum);		// written without a fill: power limit first
+	inline uint16_t	getNumPix() { return nPix; };
+	inline Pattern	*firstPat() { return pats; };
+	inline uint8_t	getBpp() { return bpp; };
+	inline const LTBStats &getStats() { return stats; };
+	inline void	clearStats() { memset(&stats, 0, sizeof(stats)); };
+	void		getMemUsage(LTBMem &m);
 	void		clearPats();
 	void		clearLights(RGB fill);
 	void		sendTrailer();
 	void		sendLeader();
+	uint16_t	leaderLen();
+	uint16_t	trailerLen();
+	inline void	setOutput(DotsOut *o) { out = o; };
+	void		setClock(DotsClock *c);
+	inline void	setTimestep(uint16_t ms) { tStep = ms; tAccum = 0; };	// 0: actions see the real delta
+	inline void	setSpeed(uint16_t spd) { speed = spd; };	// TIME_1X = real time
+	inline void	pause(bool p) { paused = p; };
+	inline uint32_t	getTime() { return simMsec; };			// msec of effect time run so far
+	bool		loadScene(const uint8_t *scene, size_t len, uint8_t *buf, size_t bufSz, bool pgm = false);
+	bool		beginStage();								// add* calls build the next scene; false while fading
+	bool		stageScene(const uint8_t *scene, size_t len, uint8_t *buf, size_t bufSz, bool pgm = false);
+	bool		crossFade(uint16_t ms);						// fade from the shown scene to the staged one
+	inline bool	fading() { return xDur != 0; };
 
 	//	~LTBDots();
 	uint8_t *curStrip;
 	uint8_t *dp;
 
 protected:
-	void	addPat(Pattern *pat);
+	bool	parseScene(const uint8_t *sp, size_t len, bool pgm, LTBArena &ar, Pattern **head);
+	void	limitPower();
+	bool	tick(bool force);
+	bool	tickActions(uint16_t deltaT);
+	void	beginFill();
+	void	endFill();
+	bool	beginSend();
+	void	endSend(bool fresh);
+	void	freeChain(Pattern *p);
+	void	dropStage();
+	uint8_t	*fillChain(Pattern *p, uint8_t *dst, uint8_t *dith, LTBFill &f);
+	uint8_t	*fillRun(Pattern *&cur, uint16_t &from, uint8_t *base, uint8_t *dst, uint8_t *dith, uint16_t max, LTBFill &f);
+	void	blendFade();
+	void	padFade();
+	uint8_t	*blendRun(uint8_t *p, size_t n);
+	void	endBlend();
+	void	endFade();
 
-	short	nPix;			// total number of leds in chain
+	uint16_t nPix;			// total number of leds in chain
+	uint8_t	pixFmt;			// PIX_xxx wire format of the chain
+	uint8_t	bpp;			// bytes per pixel in dots
 	Pattern *pats;
-	uint8_t	*dots;
-	unsigned long lastMsec;
+	uint8_t	*dots;			// frame being rendered, the back buffer when double buffered
+	uint8_t	*frame[2];		// front/back pair, both point at dots until enableDoubleBuffer
+	size_t	frameLen[2];	// bytes of pixel data rendered into each frame
+	uint32_t frameHash[2];	// hash of each frame, set by publishFrame when skipping
+	uint32_t sentHash;		// hash of the last frame that went out
+	size_t	sentLen;
+	uint32_t sentMsec;		// clock reading of the last frame that went out
+	uint16_t keepalive;		// msec between resends of an unchanged frame
+	bool	skipSame;		// setFrameSkip
+	bool	sentValid;		// sentHash describes what is on the strip
+	bool	txSkip;			// the frame being sent was skipped
+	uint16_t powerBudget;	// mA limit, 0 for no limit
+	uint8_t	mAChan;
+	uint8_t	mAIdle;
+	uint32_t powerEst;
+	LTBFill	frameFill;	// the frame being filled
+	uint8_t	powerScale;
+	uint8_t	*dither;		// temporal dither error, 4 bits per channel, NULL when off
+	uint8_t	backIdx;		// frame claimed by claimFrame
+	volatile uint8_t bufState;	// DB_FRONT | DB_READY, only changed through the swap protocol
+	LTBStats stats;
+	DotsOut	*out;			// where frames are sent, spiOut unless setOutput is called
+	LTBArena arena;			// holds the patterns of a scene from loadScene
+	Pattern	*stage;			// next scene, built by beginStage/stageScene
+	LTBArena stageArena;	// holds the patterns of a scene from stageScene
+	bool	staging;		// addPat appends to stage instead of pats
+	uint8_t	*xBuf;			// the staged scene is filled here and blended into dots
+	uint16_t xDur;			// cross-fade length in msec, 0 when not fading
+	uint32_t xStart;		// simMsec when the cross-fade started
+	uint8_t	xT;				// blend of this frame, 0-255 toward the staged scene
+	LTBFill	xFill;			// the staged scene's fill
+	uint8_t	*xEnd;			// end of what has been filled into xBuf
+	uint8_t	*xPos;			// next byte of dots showStep blends
+	uint8_t	rState;			// RS_xxx, where showStep left off
+	Pattern	*rCursor;		// next pattern showStep fills
+	uint16_t rFrom;			// and the pixel of it to start at
+	bool	rFade;			// the frame showStep is filling is a cross-fade
+	uint8_t	*txEnd;			// end of the frame being sent, dp is the next byte
+	bool	txFresh;		// frame being sent is new, for stats
+	DotsClock *clock;		// millisClock unless setClock is called
+	uint32_t lastMsec;		// clock reading at the last renderFrame
+	uint32_t simMsec;		// effect time, after speed and pause
+	uint32_t tAccum;		// effect time not yet run in fixed steps
+	uint16_t tStep;			// fixed timestep in msec, 0 for variable
+	uint16_t speed;			// TIME_1X = real time
+	uint8_t	speedRem;		// fraction of a msec carried by the speed scaling
+	bool	paused;
 
 private:
 	LTBDots(const LTBDots &c);
@@ -251,7 +1301,7 @@ private:
 
 };
 
-enum
+typedef enum
 {
 	AliceBlue = 0xF0F8FF, Amethyst = 0x9966CC, AntiqueWhite = 0xFAEBD7, Aqua = 0x00FFFF, Aquamarine = 0x7FFFD4, Azure = 0xF0FFFF, Beige = 0xF5F5DC,
 	Bisque = 0xFFE4C4, Black = 0x000000, BlanchedAlmond = 0xFFEBCD, Blue = 0x0000FF, BlueViolet = 0x8A2BE2, Brown = 0xA52A2A, BurlyWood = 0xDEB887,
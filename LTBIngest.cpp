@@ -0,0 +1,242 @@
+/*!
+* \file LTBIngest.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* E1.31 / Art-Net DMX ingestion into LTBDots frames
+*/
+
+#include "LTBIngest.h"
+
+static const uint8_t artnetId[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+static const uint8_t acnId[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+#define ARTNET_HDRLEN	18
+#define E131_HDRLEN		126			// through the DMX start code
+
+
+LTBIngest::LTBIngest(LTBDots *s)
+{
+	strip = s;
+	frame = NULL;
+	nMap = 0;
+	seen = 0;
+	memset(&stats, 0, sizeof(stats));
+}
+
+/**
+**  This function routes a universe to numPix pixels starting at firstPix.  firstSlot is
+**  the 0 based DMX slot holding the first pixel's red.  Returns false when the table is
+**  full or the range runs off the strip.
+**/
+bool
+LTBIngest::mapUniverse(uint16_t uni, uint16_t firstPix, uint16_t numPix, uint16_t firstSlot)
+{
+	if (nMap == INGEST_MAXUNI || (uint32_t)firstPix + numPix > strip->getNumPix())
+		return false;
+
+	UniMap *m = &map[nMap++];
+	m->uni = uni;
+	m->firstPix = firstPix;
+	m->numPix = numPix;
+	m->firstSlot = firstSlot;
+	m->kp = NULL;
+	m->chanSum = 0;
+	m->seqValid = false;
+	return true;
+}
+
+/**
+**  This function routes a universe into kp's key buffer instead of the frame.  kp is
+**  committed as a new keyframe each time a complete frame has arrived.
+**/
+bool
+LTBIngest::mapUniverse(uint16_t uni, keyPat *kp, uint16_t firstPix, uint16_t numPix, uint16_t firstSlot)
+{
+	if (nMap == INGEST_MAXUNI || (uint32_t)firstPix + numPix > kp->getNumPix())
+		return false;
+
+	UniMap *m = &map[nMap++];
+	m->uni = uni;
+	m->firstPix = firstPix;
+	m->numPix = numPix;
+	m->firstSlot = firstSlot;
+	m->kp = kp;
+	m->chanSum = 0;
+	m->seqValid = false;
+	return true;
+}
+
+uint8_t
+LTBIngest::parse(const uint8_t *pkt, uint16_t len)
+{
+	uint8_t r = INGEST_IGNORED;
+
+	stats.packets++;
+	if (len >= ARTNET_HDRLEN && memcmp(pkt, artnetId, sizeof(artnetId)) == 0)
+		r = parseArtNet(pkt, len);
+	else if (len >= E131_HDRLEN && memcmp(pkt + 4, acnId, sizeof(acnId)) == 0)
+		r = parseE131(pkt, len);
+
+	if (r == INGEST_OK)
+		stats.accepted++;
+	else if (r == INGEST_STALE)
+		stats.stale++;
+	else if (r == INGEST_BAD)
+		stats.bad++;
+	return r;
+}
+
+/************************************************************************/
+/* ArtDmx: id, OpCode 0x5000 (LE), ProtVer, Sequence, Physical,         */
+/* SubUni, Net, Length (BE), data                                       */
+/************************************************************************/
+uint8_t
+LTBIngest::parseArtNet(const uint8_t *pkt, uint16_t len)
+{
+	if (pkt[8] != 0x00 || pkt[9] != 0x50)
+		return INGEST_IGNORED;						// not OpDmx
+
+	uint16_t n = (pkt[16] << 8) | pkt[17];
+	if (n > 512 || ARTNET_HDRLEN + n > len)
+		return INGEST_BAD;
+
+	uint16_t uni = ((pkt[15] & 0x7f) << 8) | pkt[14];
+	return dmx(uni, pkt[12], pkt[12] != 0, pkt + ARTNET_HDRLEN, n);	// sequence 0 means unused
+}
+
+/************************************************************************/
+/* E1.31 data packet: root layer (vector 4), framing layer (vector 2,   */
+/* sequence @111, options @112 (0x80 preview, 0x40 terminated, 0x20     */
+/* force sync), universe @113), DMP layer (count @123,                  */
+/* start code @125, slots from 126)                                     */
+/************************************************************************/
+uint8_t
+LTBIngest::parseE131(const uint8_t *pkt, uint16_t len)
+{
+	if (pkt[0] != 0x00 || pkt[1] != 0x10)
+		return INGEST_BAD;
+	if (pkt[18] | pkt[19] | pkt[20] || pkt[21] != 0x04)
+		return INGEST_IGNORED;						// sync or discovery
+	if (pkt[40] | pkt[41] | pkt[42] || pkt[43] != 0x02)
+		return INGEST_IGNORED;
+	if (pkt[112] & 0xc0)
+		return INGEST_IGNORED;						// preview data or stream terminated
+	if (pkt[117] != 0x02 || pkt[118] != 0xa1)
+		return INGEST_BAD;
+
+	uint16_t count = (pkt[123] << 8) | pkt[124];	// includes the start code
+	if (count < 1 || count > 513 || 125 + count > len)
+		return INGEST_BAD;
+	if (pkt[125] != 0)
+		return INGEST_IGNORED;						// not DMX512 level data
+
+	uint16_t uni = (pkt[113] << 8) | pkt[114];
+	return dmx(uni, pkt[111], true, pkt + E131_HDRLEN, count - 1);
+}
+
+/************************************************************************/
+/* This function copies n pixels of DMX data into the frame, returns    */
+/* the sum of their channel bytes                                       */
+/************************************************************************/
+template <class F> uint32_t
+LTBIngest::writePix(uint8_t *dst, const uint8_t *d, uint16_t n)
+{
+	uint32_t sum = 0;
+
+	while (n--)
+	{
+		sum += d[0] + d[1] + d[2];
+		dst = F::put(dst, d[0], d[1], d[2]);
+		d += 3;
+	}
+	return sum;
+}
+
+/**
+**  This function writes n DMX slots for universe uni into the claimed frame.
+**/
+uint8_t
+LTBIngest::dmx(uint16_t uni, uint8_t seq, bool useSeq, const uint8_t *d, uint16_t n)
+{
+	uint8_t i;
+	UniMap *m;
+
+	for (i = 0; i < nMap; i++)
+		if (map[i].uni == uni)
+			break;
+	if (i == nMap)
+		return INGEST_IGNORED;
+	m = &map[i];
+
+	if (useSeq)
+	{
+		int8_t diff = (int8_t)(seq - m->lastSeq);
+		if (m->seqValid && diff <= 0 && diff > -20)
+			return INGEST_STALE;
+		m->lastSeq = seq;
+		m->seqValid = true;
+	}
+
+	uint16_t cnt = n > m->firstSlot ? (n - m->firstSlot) / 3 : 0;
+	if (cnt > m->numPix)
+		cnt = m->numPix;
+
+	d += m->firstSlot;
+	if (m->kp)
+	{
+		memcpy(m->kp->keyBuf() + m->firstPix, d, cnt * 3);		// RGB, same order as DMX
+		return markSeen(i);
+	}
+
+	if (frame == NULL)
+		frame = strip->claimFrame();
+	uint8_t *dst = frame + (size_t)m->firstPix * strip->getBpp();
+	switch (strip->getPixelFormat())
+	{
+	case PIX_WS2801:	m->chanSum = writePix<FmtWS2801>(dst, d, cnt);	break;
+	case PIX_SK9822:	m->chanSum = writePix<FmtSK9822>(dst, d, cnt);	break;
+	default:			m->chanSum = writePix<FmtAPA102>(dst, d, cnt);	break;
+	}
+	return markSeen(i);
+}
+
+uint8_t
+LTBIngest::markSeen(uint8_t i)
+{
+	seen |= 1UL << i;
+	if (seen == (nMap == 32 ? 0xffffffffUL : (1UL << nMap) - 1))
+		publish();
+	return INGEST_OK;
+}
+
+void
+LTBIngest::publish()
+{
+	uint8_t i, j;
+
+	if (seen == 0 && frame == NULL)
+		return;
+	for (i = 0; i < nMap; i++)						// commit each keyPat once
+	{
+		if (map[i].kp == NULL || !(seen & (1UL << i)))
+			continue;
+		for (j = 0; j < i; j++)
+			if (map[j].kp == map[i].kp && (seen & (1UL << j)))
+				break;
+		if (j == i)
+			map[i].kp->commitKey();
+	}
+	if (frame)
+	{
+		uint32_t sum = 0;
+		for (i = 0; i < nMap; i++)					// a universe missed this frame counts its last write
+			if (map[i].kp == NULL)
+				sum += map[i].chanSum;
+		strip->publishFrame((size_t)strip->getNumPix() * strip->getBpp(), sum);
+	}
+	frame = NULL;
+	seen = 0;
+	stats.frames++;
+}
@@ -0,0 +1,86 @@
+// LTBIngest.h
+
+#ifndef _LTBINGEST_h
+#define _LTBINGEST_h
+
+#include "LTBDots.h"
+
+#ifndef INGEST_MAXUNI
+#define INGEST_MAXUNI	8			// universes one LTBIngest can map, at most 32
+#endif
+
+#define INGEST_OK		0			// DMX data written into the frame
+#define INGEST_IGNORED	1			// not DMX data, preview data, or universe not mapped
+#define INGEST_STALE	2			// out of sequence, dropped
+#define INGEST_BAD		3			// malformed packet
+
+#define ARTNET_PORT		6454
+#define E131_PORT		5568
+
+typedef struct LTBIngestStats
+{
+	uint32_t	packets;		// packets handed to parse
+	uint32_t	accepted;		// DMX packets written into the frame
+	uint32_t	stale;			// dropped for sequence
+	uint32_t	bad;			// malformed
+	uint32_t	frames;			// complete frames published
+} LTBIngestStats;
+
+/*!
+* \class LTBIngest
+*
+* \brief E1.31 (sACN) and Art-Net ArtDmx parser writing straight into LTBDots frames
+*
+* The network side is left to the caller: hand each UDP payload to parse.  Each mapped
+* universe covers a run of pixels, 3 DMX slots per pixel, and is written into the
+* strip's claimed frame in its wire format with no intermediate copy.  When every mapped
+* universe has arrived the frame is published and the next sendFrame/showLights sends it.
+* Sequence numbers are checked per universe as E1.31 specifies: a packet up to 19 behind
+* the last one seen is dropped, anything else (including a wrap) is accepted.
+* The channel bytes are summed as they are copied, so the strip's setPowerBudget limit
+* is applied to ingested frames as to rendered ones.
+* A universe can instead be mapped onto a keyPat, which takes each complete frame as a
+* keyframe and interpolates to it, for smooth motion from a 20-30 fps source.
+*
+* \author Kevin Wilson
+* \date
+*/
+class LTBIngest
+{
+public:
+	LTBIngest(LTBDots *s);
+
+	bool			mapUniverse(uint16_t uni, uint16_t firstPix, uint16_t numPix, uint16_t firstSlot = 0);
+	bool			mapUniverse(uint16_t uni, keyPat *kp, uint16_t firstPix, uint16_t numPix, uint16_t firstSlot = 0);
+	uint8_t			parse(const uint8_t *pkt, uint16_t len);
+	void			publish();								// send what has arrived so far
+	inline const LTBIngestStats &getStats() { return stats; };
+
+protected:
+	uint8_t			parseArtNet(const uint8_t *pkt, uint16_t len);
+	uint8_t			parseE131(const uint8_t *pkt, uint16_t len);
+	uint8_t			dmx(uint16_t uni, uint8_t seq, bool useSeq, const uint8_t *d, uint16_t n);
+	uint8_t			markSeen(uint8_t i);
+	template <class F> uint32_t	writePix(uint8_t *dst, const uint8_t *d, uint16_t n);
+
+	typedef struct UniMap
+	{
+		uint16_t	uni;
+		uint16_t	firstPix;
+		uint16_t	numPix;
+		uint16_t	firstSlot;		// DMX slot of the first pixel's red
+		keyPat		*kp;			// keyframe target, NULL to write the frame
+		uint32_t	chanSum;		// channel bytes of its last write, for the power limit
+		uint8_t		lastSeq;
+		bool		seqValid;
+	} UniMap;
+
+	LTBDots			*strip;
+	uint8_t			*frame;			// claimed frame, NULL until the first packet of a frame
+	UniMap			map[INGEST_MAXUNI];
+	uint8_t			nMap;
+	uint32_t		seen;			// bit per map entry received since the last publish
+	LTBIngestStats	stats;
+};
+
+#endif
@@ -8,7 +8,8 @@
 */
 
 
-#include "LTBdots.h"
+#include "LTBDots.h"
+#include "LTBScene.h"
 
 
 /************************************************************************/
@@ -37,19 +38,6 @@ toiRGB(RGB c)
 	return res;
 }
 
-/************************************************************************/
-/* This function converts an iRGB back to an 8 bit RGB                  */
-/************************************************************************/
-RGB
-toRGB(iRGB c)
-{
-	RGB res;
-	res.r = c.r >> SCALE;
-	res.g = c.g >> SCALE;
-	res.b = c.b >> SCALE;
-	return res;
-};
-
 /***************************************************************************/
 /* This function adds 2 iRGBs assuming they were fix point scaled by SCALE */
 /***************************************************************************/
@@ -64,19 +52,6 @@ addRGB(iRGB c1, iRGB c2)
 };
 
 
-/***************************************************************************/
-/* This function adds 2 iRGBs assuming they were fix point scaled by SCALE */
-/***************************************************************************/
-iRGB
-addiRGB(iRGB c1, iRGB c2)
-{
-	iRGB sum;
-	sum.r = c1.r + c2.r;
-	sum.g = c1.g + c2.g;
-	sum.b = c1.b + c2.b;
-	return sum;
-}
-
 RGB
 incRGB(iRGB &accum, iRGB delta)
 {
@@ -105,6 +80,7 @@ Pattern::Pattern(uint8_t pct)
 {
 	nxt = 0;
 	acts = 0;
+	inArena = false;
 	setOnLvl(pct);
 }
 
@@ -116,7 +92,8 @@ Pattern::doActions(uint16_t deltaT)
 
 	while (actP)
 	{
-		changed = (changed || actP->timerTic(deltaT));
+		if (actP->timerTic(deltaT))		// every action must see the tick
+			changed = true;
 		actP = actP->nxt;
 	}
 	// need separate loop to delete completed actions
@@ -128,7 +105,7 @@ Pattern::doActions(uint16_t deltaT)
 uint8_t
 Pattern::getOnLvl()
 {
-	return (uint8_t)((float)onLvl / 1.28);
+	return ((uint16_t)onLvl * 100 + LVL_FULL / 2) / LVL_FULL;
 }
 
 
@@ -147,6 +124,8 @@ actionOnLvl::setDimAct(Pattern *ptr, uint8_t tgt, ushort dur)
 
 	if (dur < MINTIC)
 		dur = MINTIC;
+	if (dur > 32767)
+		dur = 32767;							// durTime is a short
 
 	dY = (float)(tgt - pat->getOnLvl()) / (float)dur;		// calc. dY/dX (pct change per mSec
 
@@ -181,16 +160,17 @@ bool
 actionOnLvl::timerTic(unsigned short deltaT)
 {
 	bool changed = false;
-	int8_t	newLvl;
+	int16_t	newLvl;
 
 	if (actionComplete)
 		return false;
 
-	durTmr += deltaT;
-	if (durTmr > durTime)
+	if ((long)durTmr + deltaT > durTime)		// in long, a delta over 32767 would wrap a short
 		durTmr = durTime;
+	else
+		durTmr += deltaT;
 
-	newLvl = (byte)(dY*durTmr) + startLvl;
+	newLvl = startLvl + (int16_t)(dY * durTmr + (dY < 0 ? -0.5f : 0.5f));	// rounded, so it ends on the target
 	if (newLvl == nxtLvl)
 		return false;
 	else
@@ -204,25 +184,92 @@ actionOnLvl::timerTic(unsigned short deltaT)
 void
 Pattern::dimPat(uint8_t tgt, ushort dur)
 {
-	Action *ptr = acts;
-
-	if (ptr)
-	{
-		while (!ptr->isLast())
+	for (Action *ptr = acts; ptr; ptr = ptr->nxt)
+		if (ptr->actionType() == DIMMER)
 		{
-			if (ptr->actionType() == DIMMER)
-			{
-				ptr->setDimAct(this, tgt, dur);
-				return;
-			}
-			ptr = ptr->nxt;
+			ptr->setDimAct(this, tgt, dur);			// retarget the dimmer already there
+			return;
 		}
-	}
 	Action *act = new actionOnLvl(this, tgt, dur);
 	addAct(act);
 }
 
 
+/************************************************************************/
+/* This function attaches an actionAnim so advance() runs every frame   */
+/************************************************************************/
+void
+Pattern::animate()
+{
+	for (Action *ptr = acts; ptr; ptr = ptr->nxt)
+		if (ptr->actionType() == ANIMATE)
+			return;
+	addAct(new actionAnim(this));
+}
+
+void
+Pattern::unanimate()
+{
+	for (Action **pp = &acts; *pp; pp = &(*pp)->nxt)
+		if ((*pp)->actionType() == ANIMATE)
+		{
+			Action *a = *pp;
+			*pp = a->nxt;
+			ltbFree(a);
+			return;
+		}
+}
+
+bool
+actionAnim::timerTic(unsigned short deltaT)
+{
+	return pat->advance(deltaT);
+}
+
+/**
+**  This function resumes the script once any LTB_WAIT has run out.  Overshoot is kept
+**  in wait so back to back waits don't drift.
+**/
+bool
+actionScript::timerTic(unsigned short deltaT)
+{
+	if (lc == LTB_DONE)
+		return false;
+	if (wait > 0)
+	{
+		wait -= deltaT;
+		if (wait > 0)
+			return false;
+	}
+
+	bool changed = run();
+	if (lc == LTB_DONE)
+		durTmr = durTime;							// complete
+	return changed;
+}
+
+bool
+Pattern::busy()
+{
+	for (Action *a = acts; a; a = a->nxt)
+		if (a->actionType() == DIMMER && !a->isComplete())		// the rest run forever
+			return true;
+	return false;
+}
+
+
+/************************************************************************/
+/* This function adds the heap actions to m.  Subclasses add their      */
+/* object and buffers, then call this                                   */
+/************************************************************************/
+void
+Pattern::memUsage(LTBMem &m)
+{
+	for (Action *a = acts; a; a = a->nxt)
+		if (!a->isArena())
+			m.actions += a->memSize();
+}
+
 void
 Pattern::addAct(Action *act)
 {
@@ -242,7 +289,9 @@ Pattern::addAct(Action *act)
 void
 Pattern::updateLvl(int8_t deltaPct)
 {
-	onLvl += deltaPct;
+	int16_t l = getOnLvl() + deltaPct;
+
+	setOnLvl(l < 0 ? 0 : l > 100 ? 100 : l);
 
 	/*	uint8_t curByte;
 		int8_t deltaP;
@@ -278,7 +327,7 @@ Pattern::updateLvl(int8_t deltaPct)
 void
 Pattern::setOnLvl(uint8_t pct)
 {
-	onLvl = pct;
+	onLvl = pct >= 100 ? LVL_FULL : ((uint16_t)pct * LVL_FULL + 50) / 100;
 /*
 	uint8_t curByte;
 
@@ -316,23 +365,88 @@ pixPat::pixPat()
 	numPix = 0;
 	numReps = 0;
 	color = NULL;
+	refs = NULL;
+	current = initPix = NULL;
+	delta = NULL;
+	fadePix = 0;
 }
 
 pixPat::~pixPat()
 {
 	numPix = numReps = 0;
 	clearFader();
+	releaseColors();
 }
 
 pixPat::pixPat(const pixPat &p)
 {
 	numPix = p.numPix;
 	numReps = p.numReps;
+	onLvl = p.onLvl;
 
 	nxt = NULL;
-	color = new RGB[numPix];
-	memcpy((uint8_t *)color, (uint8_t *)p.color, numPix * 3);
-	current = delta = initPix = NULL;
+	color = p.color;								// shared until one of us writes
+	refs = p.refs;
+	if (refs)
+		(*refs)++;
+	current = initPix = NULL;
+	delta = NULL;
+	fadePix = 0;
+}
+
+pixPat *
+pixPat::clone()
+{
+	return new pixPat(*this);
+}
+
+void
+pixPat::newColors()
+{
+	refs = new uint16_t[colorCost(numPix) / sizeof(uint16_t)];
+	*refs = 1;
+	color = (RGB *)(refs + 1);
+}
+
+/**
+**  This function gives the pattern its own copy of the colors if anything else can see
+**  them: the caller's array, or a buffer shared with clones.
+**/
+void
+pixPat::ownColors()
+{
+	if (!isShared())
+		return;
+
+	RGB *old = color;
+	uint16_t *oldRefs = refs;
+	newColors();
+	memcpy(color, old, numPix * sizeof(RGB));
+	if (oldRefs)
+		(*oldRefs)--;								// the others still hold it
+}
+
+/**
+**  This function returns color indx to be written, then shown by the next fill.  A
+**  pattern built on the caller's array (or sharing a clone's) first takes its own copy
+**  on the heap, colorCost(numPix) bytes, about numPix * 3; on a 2 KB board budget for
+**  it.  After that, writes to the caller's array no longer reach this pattern.
+**/
+RGB *
+pixPat::editCol(short indx)
+{
+	if (indx < 0)
+		indx = 0;
+	ownColors();
+	return color + indx;
+}
+
+void
+pixPat::releaseColors()
+{
+	if (refs && --(*refs) == 0)
+		delete[]refs;
+	refs = NULL;
 }
 
 pixPat::pixPat(RGB *leds, uint8_t nleds, uint16_t nreps, uint8_t onlvl) :Pattern(onlvl)
@@ -341,7 +455,10 @@ pixPat::pixPat(RGB *leds, uint8_t nleds, uint16_t nreps, uint8_t onlvl) :Pattern
 	numReps = nreps;
 	nxt = NULL;
 	color = leds;
-	current = delta = initPix = NULL;
+	refs = NULL;
+	current = initPix = NULL;
+	delta = NULL;
+	fadePix = 0;
 }
 
 
@@ -350,18 +467,8 @@ LTBDots::setOnLvl(uint8_t pct)
 {
 	//	dim each pattern in strip
 
-	if (pats == NULL)
-		return;					// empty strip, just return
-	else
-	{
-		Pattern *ptr = pats;
-		do
-		{
-			ptr->setOnLvl(pct);
-			ptr = ptr->Nxt();
-		} while (!ptr->isLast());
-		ptr->setOnLvl(pct);		// take care of the last one
-	}
+	for (Pattern *ptr = pats; ptr; ptr = ptr->Nxt())
+		ptr->setOnLvl(pct);
 }
 
 
@@ -377,7 +484,7 @@ Pattern::cleanCompleteActions()
 	while (acts->isComplete() && acts)		// loop on first action until we find one that is not completed
 	{
 		ptr = acts->nxt;
-		delete acts;
+		ltbFree(acts);
 		acts = ptr;
 	}
 	if (!acts)								// acts now points to an incomplete action.. or null list
@@ -390,7 +497,7 @@ Pattern::cleanCompleteActions()
 		{
 			ptrCmp = ptr->nxt;				// save next pointer of completed action
 			ptr->nxt = ptrCmp->nxt;			// point around action to be deleted...
-			delete ptrCmp;					// and delete it
+			ltbFree(ptrCmp);				// and delete it
 		}
 		else
 			ptr = ptr->nxt;					// next action
@@ -399,6 +506,14 @@ Pattern::cleanCompleteActions()
 
 
 
+void
+Action::deleteNext()
+{
+	Action *nnxt = nxt->nxt;
+	ltbFree(nxt);
+	nxt = nnxt;
+}
+
 void
 Pattern::deleteAct(Action *actToDel)
 {
@@ -410,7 +525,7 @@ Pattern::deleteAct(Action *actToDel)
 	if (acts == actToDel)
 	{
 		acts = actToDel->nxt;
-		delete ptr;
+		ltbFree(ptr);
 		return;
 	}
 
@@ -427,7 +542,7 @@ Pattern::deleteAct(Action *actToDel)
 }
 
 Pattern *
-LTBDots::addPat(RGB *pix, uint8_t np, uint8_t nr, uint8_t onlvl)
+LTBDots::addPat(RGB *pix, uint8_t np, uint16_t nr, uint8_t onlvl)
 {
 	Pattern *p = new pixPat(pix, np, nr, onlvl);
 	addPat(p);
@@ -443,15 +558,53 @@ LTBDots::addTrans(RGB *pix, short nr, uint8_t onlvl)
 	return p;
 }
 
+Pattern *
+LTBDots::addNoise(RGB *pal, uint8_t npal, uint16_t npix, uint16_t scale, uint16_t speed, uint8_t onlvl)
+{
+	Pattern *p = new noisePat(pal, npal, npix, scale, speed, onlvl);
+	addPat(p);
+	p->animate();
+	return p;
+}
+
+keyPat *
+LTBDots::addKeys(uint8_t npix, uint16_t nreps, uint8_t onlvl)
+{
+	keyPat *p = new keyPat(npix, nreps, onlvl);
+	addPat(p);
+	p->animate();
+	return p;
+}
+
+Pattern *
+LTBDots::addHue(uint16_t npix, uint16_t step, int16_t speed, uint8_t sat, uint8_t val, uint8_t onlvl)
+{
+	Pattern *p = new huePat(npix, step, speed, sat, val, onlvl);
+	addPat(p);
+	p->animate();
+	return p;
+}
+
+Pattern *
+LTBDots::addSparkle(Pattern *bg, uint16_t npix, uint8_t cap, RGB *pal, uint8_t npal, uint8_t onlvl)
+{
+	Pattern *p = new sparklePat(bg, npix, cap, pal, npal, onlvl);
+	addPat(p);
+	p->animate();
+	return p;
+}
+
 void
 LTBDots::addPat(Pattern *pat)
 {
+	Pattern **head = staging ? &stage : &pats;
+
 	// find end of pattern chain
-	if (pats == NULL)
-		pats = pat;				// just set this as the first pat in the strip
+	if (*head == NULL)
+		*head = pat;			// just set this as the first pat in the strip
 	else
 	{
-		Pattern *ptr = pats;
+		Pattern *ptr = *head;
 		while (!ptr->isLast())
 		{
 			ptr = ptr->Nxt();
@@ -467,19 +620,20 @@ LTBDots::printStrip(char *title, bool dotsOnly)
 		Serial.println("*** DOTS ONLY ***");
 	else
 	{
-		Serial.print("this    = 0x"); Serial.println((uint16_t)this, 16);
+		Serial.print("this    = 0x"); Serial.println((unsigned long)this, 16);
 		Serial.print("MaxPix  =   "); Serial.println(nPix);
-		Serial.print("dots  =   0x"); Serial.println((uint16_t)dots);
+		Serial.print("dots  =   0x"); Serial.println((unsigned long)dots, 16);
 		Serial.print("lastMS  =   "); Serial.println(lastMsec);
 	}
-	Serial.println("Pix\tTag\tBlu\tGrn\tRed");
+	Serial.println("Pix\twire bytes");
 	for (int i = 0; i < nPix; i++)
 	{
 		Serial.print(""); Serial.print(i);
-		Serial.print("\t0x"); Serial.print(  dots[i * 4 +0], HEX);
-		Serial.print("\t0x"); Serial.print(  dots[i * 4 +1], HEX);
-		Serial.print("\t0x"); Serial.print(  dots[i * 4 +2], HEX);
-		Serial.print("\t0x"); Serial.println(dots[i * 4 +3], HEX);
+		for (int j = 0; j < bpp; j++)
+		{
+			Serial.print("\t0x"); Serial.print(dots[i * bpp + j], HEX);
+		}
+		Serial.println();
 	}
 
 	if (pats == NULL)
@@ -502,12 +656,12 @@ void
 Pattern::printPat(char *title)
 {
 	Serial.print(title);
-	Serial.print("\nPat, this   = 0x"); Serial.print((uint16_t)this, 16);
-	Serial.print("\nPat, next   = 0x"); Serial.print((uint16_t)nxt, 16);
+	Serial.print("\nPat, this   = 0x"); Serial.print((unsigned long)this, 16);
+	Serial.print("\nPat, next   = 0x"); Serial.print((unsigned long)nxt, 16);
 	Serial.print("\nPat, npix   =   "); Serial.print(numPix);
 	Serial.print("\nPat, nreps  =   "); Serial.print(numReps);
-	Serial.print("\nPat, on Lvl =   "); Serial.print((uint8_t)((float)onLvl / 1.28)); Serial.print("%");
-	Serial.print("\nPat, Actions=   "); Serial.println((short)acts);
+	Serial.print("\nPat, on Lvl =   "); Serial.print(getOnLvl()); Serial.print("%");
+	Serial.print("\nPat, Actions=   "); Serial.println((unsigned long)acts, 16);
 
 	for (int i = 0; i<numPix; i++)
 	{
@@ -525,6 +679,7 @@ pixPat::fillPat(RGB fill, int start, int end)
 	if (start == -1) start = 0;
 	if (end == -1) end = numPix - 1;
 
+	ownColors();
 	for (int i = start; i <= end; i++)
 		memcpy((uint8_t *)&color[i], (uint8_t *)&fill, 3);
 	return;
@@ -539,14 +694,17 @@ pixPat::fillPat(RGB fill, int start, int end)
 void
 pixPat::rotateLeft(uint8_t num)
 {
+	if (numPix == 0 || (num %= numPix) == 0)
+		return;
 	short n = (num << 1) + num;						// bytes per pixel	(x3)
+	ownColors();
 	leftRot((uint8_t *)color, n);
 }
 
 void
 pixPat::leftRot(uint8_t *p, short num)
 {
-	uint8_t	rlen = (numPix << 1) + numPix;		// total length		(x3)
+	uint16_t rlen = (numPix << 1) + numPix;		// total length		(x3)
 	uint8_t *tmp = new uint8_t[num];			// save off the overlay part
 
 	memcpy(tmp, p, num);					// save off the overlap
@@ -563,15 +721,17 @@ pixPat::leftRot(uint8_t *p, short num)
 void
 pixPat::rotateRight(uint8_t num)
 {
+	if (numPix == 0 || (num %= numPix) == 0)
+		return;
+	ownColors();
 	uint8_t	*p = (uint8_t *)color;
-	uint8_t *tmp = new uint8_t[num];
-	uint8_t	rlen = (numPix << 1) + numPix;		// total length		(x3)
-
-	num = (num << 1) + num;						// bytes per pixel	(x3)
+	uint16_t rlen = (numPix << 1) + numPix;		// total length		(x3)
+	uint16_t n = (num << 1) + num;				// bytes per pixel	(x3)
+	uint8_t *tmp = new uint8_t[n];
 
-	memcpy(tmp, p + rlen - num, num);			// save off the overlap
-	memmove(p + num, color, rlen - num);		// shift the array up
-	memcpy(p, tmp, num);					// put the overlap back at the end
+	memcpy(tmp, p + rlen - n, n);				// save off the overlap
+	memmove(p + n, p, rlen - n);				// shift the array up
+	memcpy(p, tmp, n);						// put the overlap back at the start
 	delete[]tmp;
 }
 
@@ -581,6 +741,7 @@ pixPat::rotateRight(uint8_t num)
 void
 pixPat::mergePix(pixPat &p1, uint8_t startPix1, pixPat &p2, uint8_t startPix2)
 {
+	ownColors();
 	memcpy(color + startPix1, p1.color, p1.numPix * 3);		// first set p1 into the destination pattern
 	for (uint8_t i = 0; i<p2.numPix; i++)					// now merge in p2 over p1
 		color[i + startPix2] = blendRGB(color[i + startPix2], p2.color[i]);
@@ -593,14 +754,19 @@ pixPat::initFader(RGB *fadeEnd, short fadeSteps)
 	uint8_t *sbuf = (uint8_t *)color;
 	uint8_t *ebuf = (uint8_t *)fadeEnd;
 
-	initPix = new short[3 * numPix];
-	current = new short[3 * numPix];
-	delta = new short[3 * numPix];
+	if (current == NULL || fadePix != numPix)		// reuse the buffers when re-fading
+	{
+		clearFader();
+		initPix = new ushort[3 * numPix];
+		current = new ushort[3 * numPix];
+		delta = new short[3 * numPix];
+		fadePix = numPix;
+	}
 
 	for (int i = 0; i<numPix * 3; i++)
 	{
-		current[i] = initPix[i] = (short)(sbuf[i]) << SCALE;
-		delta[i] = (short)((ebuf[i] - sbuf[i]) << SCALE) / fadeSteps;
+		current[i] = initPix[i] = (ushort)(sbuf[i]) << SCALE;
+		delta[i] = ((long)(ebuf[i] - sbuf[i]) << SCALE) / fadeSteps;
 	}
 }
 
@@ -611,30 +777,63 @@ pixPat::clearFader()
 	if (current) delete[]current;
 	if (delta)   delete[]delta;
 	if (initPix) delete[]initPix;
-	current = delta = initPix = NULL;
+	current = initPix = NULL;
+	delta = NULL;
+	fadePix = 0;
 }
 
 void
 pixPat::stepFader()
 {
+	ownColors();
 	uint8_t *cbuf = (uint8_t *)color;
 
 	for (int i = 0; i<numPix * 3; i++)
 	{
-		current[i] += delta[i];
-		current[i]> 255 << SCALE ? 255 << SCALE : current[i];	// max limit
-		current[i]< 0 ? 0 : current[i];					// min limit
+		long c = (long)current[i] + delta[i];
+		if (c > (255L << SCALE)) c = 255L << SCALE;		// max limit
+		if (c < 0) c = 0;								// min limit
+		current[i] = c;
 		cbuf[i] = current[i] >> SCALE;
 	}
 	return;
 }
 
+void
+pixPat::memUsage(LTBMem &m)
+{
+	if (!inArena)
+		m.patterns += sizeof(*this);
+	if (current)
+		m.buffers += faderCost(fadePix);
+	if (refs)
+		m.buffers += colorCost(numPix) / *refs;			// split between the sharers
+	Pattern::memUsage(m);								// else color belongs to the caller
+}
+
+void
+pixPat::setFader(ushort step)
+{
+	ownColors();
+	uint8_t *cbuf = (uint8_t *)color;
+
+	for (int i = 0; i<numPix * 3; i++)
+	{
+		long c = (long)initPix[i] + (long)delta[i] * step;
+		if (c > (255L << SCALE)) c = 255L << SCALE;		// max limit
+		if (c < 0) c = 0;								// min limit
+		current[i] = c;
+		cbuf[i] = current[i] >> SCALE;
+	}
+}
+
 void
 pixPat::resetFader()
 {
+	ownColors();
 	uint8_t *cbuf = (uint8_t *)color;
 
-	memcpy(current, initPix, numPix * 3 * sizeof(short));
+	memcpy(current, initPix, numPix * 3 * sizeof(ushort));
 
 	for (int i = 0; i<numPix * 3; i++)
 		cbuf[i] = current[i] >> SCALE;
@@ -643,6 +842,7 @@ pixPat::resetFader()
 void
 pixPat::fadeNeighbors(RGB prev)
 {
+	ownColors();
 	color[0] = prev;							// previous border pix given to us
 	if (nxt == NULL)
 		color[numPix - 1] = CLR(0, 0, 0);
@@ -654,6 +854,70 @@ pixPat::fadeNeighbors(RGB prev)
 }
 
 
+keyPat::keyPat(uint8_t npix, uint16_t nreps, uint8_t onlvl) :pixPat(NULL, npix, nreps, onlvl)
+{
+	newColors();
+	next = new RGB[npix];
+	memset(color, 0, npix * sizeof(RGB));
+	memset(next, 0, npix * sizeof(RGB));
+	interval = elapsed = sinceKey = 0;
+	step = KEY_STEPS;
+	initFader(next, KEY_STEPS);						// allocate the fader once
+}
+
+keyPat::~keyPat()
+{
+	clearFader();
+	delete[]next;
+}
+
+/**
+**  This function starts interpolating from the colors currently on show to keyBuf()
+**  over intervalMs.  Catches up to the previous key first if it hadn't got there.
+**/
+void
+keyPat::commitKey(uint16_t intervalMs)
+{
+	interval = intervalMs ? intervalMs : sinceKey;
+	sinceKey = elapsed = 0;
+	initFader(next, KEY_STEPS);						// start = color, as shown right now
+	step = 0;										// advance jumps straight there if interval is 0
+}
+
+void
+keyPat::pushKey(const RGB *key, uint16_t intervalMs)
+{
+	memcpy(next, key, numPix * sizeof(RGB));
+	commitKey(intervalMs);
+}
+
+void
+keyPat::memUsage(LTBMem &m)
+{
+	m.patterns += sizeof(*this);
+	m.buffers += colorCost(numPix) + (size_t)numPix * sizeof(RGB);		// color and next
+	if (current)
+		m.buffers += faderCost(fadePix);
+	Pattern::memUsage(m);
+}
+
+bool
+keyPat::advance(uint16_t deltaT)
+{
+	sinceKey = (uint32_t)sinceKey + deltaT > 0xffff ? 0xffff : sinceKey + deltaT;
+	if (step >= KEY_STEPS)
+		return false;
+
+	elapsed = (uint32_t)elapsed + deltaT > interval ? interval : elapsed + deltaT;
+	ushort s = interval ? ((uint32_t)elapsed * KEY_STEPS) / interval : KEY_STEPS;
+	if (s == step)
+		return false;
+	step = s;
+	setFader(step);
+	return true;
+}
+
+
 RTPat::RTPat(RGB *c, uint16_t nReps, uint8_t onlvl) :Pattern(onlvl)
 {
 	Serial.println("RTPat const");
@@ -662,6 +926,14 @@ RTPat::RTPat(RGB *c, uint16_t nReps, uint8_t onlvl) :Pattern(onlvl)
 	color = c;
 	reCalc();
 }
+
+void
+RTPat::memUsage(LTBMem &m)
+{
+	if (!inArena)
+		m.patterns += sizeof(*this);
+	Pattern::memUsage(m);
+}
 /*
 bool
 RTPat::procTmr(uint8_t tID)
@@ -694,110 +966,1041 @@ RTPat::reCalc()
 
 
 
-LTBDots::LTBDots(short n)
+SPIOut spiOut;
+MillisClock millisClock;
+
+uint32_t
+MillisClock::now()
 {
-	nPix = n;
-	dots = new uint8_t[(nPix+2) * 4];
-	memset(dots, 0xde, (nPix + 2) * 4);
-	lastMsec = millis();
+	return millis();
 }
 
 void
-LTBDots::clearPats()
+SPIOut::write(const uint8_t *p, size_t n)
 {
-	// walk list and delete em.
-	Pattern *nxtp, *ptr = pats;
-
-	while (ptr)
-	{
-		nxtp = ptr->Nxt();
-		delete ptr;
-		ptr = nxtp;
-	}
-	pats = NULL;
+	while (n--)
+		SPI.transfer(*p++);
 }
 
 void
-LTBDots::clearLights(RGB fill)
+SPIOut::zeros(size_t n)
 {
-	clearPats();
-	addPat(&fill, 1, nPix);
-	printStrip("CLEAR");
-	showLights(true);
-	clearPats();
+	while (n--)
+		SPI.transfer(0);
 }
 
 
-void
-LTBDots::showLights(bool force)
+LTBDots::LTBDots(uint16_t n, uint8_t fmt)
 {
-	Pattern *ptr = pats;
-	bool changed = false;
-
-	uint16_t deltaMsec = millis() - lastMsec;
-	lastMsec = millis();
-	/**  Loop through all pats and update timed actions **/
-	//	while(ptr)			// first loop through all patterns and update timed actions
-	//	{
-	//		changed = (changed || ptr->doActions(deltaMsec));
-	//		ptr=ptr->Nxt();
-	//	}	
-
-	if (changed || force)
-	{
-		ptr = pats;
-		curStrip= dots;
-		/**  Loop through all pats and light them **/
-		while (ptr)
-		{
-			curStrip = ptr->fillRGB(curStrip);
-			ptr = ptr->Nxt();
-		}
-	}
-	printStrip("prePaint");
-	sendLeader();
-	dp= dots;
+	nPix = n;
+	pixFmt = fmt;
+	bpp = PIX_BPP(fmt);
+	frameFill.fmt = fmt;
+	frameFill.chanSum = 0;
+	pats = NULL;
+	out = &spiOut;
+	dots = new uint8_t[(size_t)nPix * bpp];
+	memset(dots, 0xde, (size_t)nPix * bpp);
+	curStrip = dp = dots;
+	frame[0] = frame[1] = dots;
+	backIdx = 0;
+	dither = NULL;
+	powerBudget = 0;
+	mAChan = MA_PER_CHAN;
+	mAIdle = MA_IDLE;
+	powerEst = 0;
+	powerScale = 31;
+	frameLen[0] = frameLen[1] = 0;
+	bufState = 0;
+	clearStats();
+	frameHash[0] = frameHash[1] = 0;
+	sentHash = 0;
+	sentLen = 0;
+	sentMsec = 0;
+	keepalive = 0;
+	skipSame = false;
+	sentValid = false;
+	txSkip = false;
+	rState = RS_IDLE;
+	rCursor = NULL;
+	rFrom = 0;
+	rFade = false;
+	txEnd = NULL;
+	txFresh = false;
+	stage = NULL;
+	staging = false;
+	xBuf = NULL;
+	xDur = 0;
+	xStart = 0;
+	xT = 0;
+	xFill.fmt = fmt;
+	xFill.chanSum = 0;
+	xEnd = xPos = NULL;
+	clock = &millisClock;
+	lastMsec = clock->now();
+	simMsec = tAccum = 0;
+	tStep = 0;
+	speed = TIME_1X;
+	speedRem = 0;
+	paused = false;
+}
 
-	while (dp != curStrip)
-		SPI.transfer(*dp++);
-	sendTrailer();
+/************************************************************************/
+/* This function bump allocates n bytes, NULL when the arena is full    */
+/************************************************************************/
+void *
+LTBArena::alloc(size_t n)
+{
+	uintptr_t a = sizeof(void *) - 1;
+	uint8_t *p = (uint8_t *)(((uintptr_t)top + a) & ~a);	// keep objects pointer aligned
 
-	return;
+	if (base == NULL || p > end || (size_t)(end - p) < n)
+		return NULL;
+	top = p + n;
+	return p;
 }
 
 
-uint8_t *
-pixPat::fillRGB(uint8_t *p)
+static inline uint8_t
+sceneByte(const uint8_t *p, bool pgm)
 {
-	uint8_t *clr;
-	uint8_t *sp=p;
+	return pgm ? pgm_read_byte(p) : *p;
+}
+
+/**
+**  This function replaces the current patterns with the scene in a buffer built by
+**  extras/ltbscene (format in LTBScene.h).  The scene is read in one pass and every
+**  Pattern, Action and palette is placed in buf, so nothing is allocated on the heap.
+**  buf must stay valid until the next loadScene or clearPats.  Set pgm if scene is
+**  in PROGMEM.  On any error the strip is left empty and false is returned.
+**  The patterns share the palettes in buf, and the first write to one (fillPat, a
+**  rotate, a fader, fadeNeighbors) takes a private copy of its colors from the heap,
+**  so a scene that has to stay off the heap must only be shown and dimmed, not written.
+**/
+bool
+LTBDots::loadScene(const uint8_t *scene, size_t len, uint8_t *buf, size_t bufSz, bool pgm)
+{
+	clearPats();
+	arena.init(buf, bufSz);
 
-	for (int i = 0; i < numReps; i++)
+	if (!parseScene(scene, len, pgm, arena, &pats))
 	{
-		clr = (uint8_t *)color;
-		for (int j = 0; j < numPix; j++)
-		{
-			*p++ = 0xff;
-			*p++ = *clr++;
-			*p++ = *clr++;
-			*p++ = *clr++;
-		}
+		clearPats();
+		return false;
 	}
-	return p;
+	return true;
+}
 
-/*
-	uint8_t *addr = (uint8_t *)color;
-	uint8_t curbyte;
-	uint8_t bitCnt;
-	Serial.print("buff adder to fill: 0x"); Serial.println((uint16_t)p, HEX);
+/**
+**  This function starts a new staged scene: until crossFade is called the add* calls
+**  build it instead of the scene on show.  Any scene staged earlier is dropped.  Not
+**  while a cross-fade is running, as the staged scene is the one being faded to.
+**/
+bool
+LTBDots::beginStage()
+{
+	if (fading())
+		return false;
+	dropStage();
+	staging = true;
+	return true;
+}
 
-	asm volatile(
-		"	push r0						\n\t"		//
-		"	push r1						\n\t"		//
-		"	adiw %[repCnt], 0			\n\t"		// just return if count is zero	
-		"	breq alldone%=				\n\t"		//
+void
+LTBDots::dropStage()
+{
+	freeChain(stage);
+	stage = NULL;
+	stageArena = LTBArena();
+}
 
-		"nextPass%=:					\n\t"
+/**
+**  This function loads a binary scene as the staged scene, like loadScene.  buf must be
+**  a different buffer from the one holding the scene on show; that one is free again
+**  once the cross-fade has finished.
+**/
+bool
+LTBDots::stageScene(const uint8_t *scene, size_t len, uint8_t *buf, size_t bufSz, bool pgm)
+{
+	if (fading())
+		return false;
+	dropStage();
+	staging = false;
+	stageArena.init(buf, bufSz);
+
+	if (!parseScene(scene, len, pgm, stageArena, &stage))
+	{
+		dropStage();
+		return false;
+	}
+	return true;
+}
+
+/**
+**  This function cross-fades from the scene on show to the staged one over ms of effect
+**  time.  Both scenes keep animating, and each frame blends them per pixel.  When the
+**  fade ends the old patterns are freed (an arena scene just resets its arena), so a
+**  scene swap built from stageScene allocates nothing.  ms = 0 swaps on the next frame.
+**/
+bool
+LTBDots::crossFade(uint16_t ms)
+{
+	staging = false;
+	if (stage == NULL || fading())
+		return false;
+	if (xBuf == NULL)
+		xBuf = new uint8_t[(size_t)nPix * bpp];		// kept for later fades
+	if (xBuf == NULL)
+		return false;
+
+	xDur = ms ? ms : 1;
+	xStart = simMsec;
+	return true;
+}
+
+void
+LTBDots::endFade()
+{
+	freeChain(pats);
+	pats = stage;
+	arena = stageArena;
+	stage = NULL;
+	stageArena = LTBArena();
+	xDur = 0;
+}
+
+bool
+LTBDots::parseScene(const uint8_t *sp, size_t len, bool pgm, LTBArena &ar, Pattern **head)
+{
+	const uint8_t *send = sp + len;
+	Pattern *tail = NULL;
+	RGB **pal;
+	uint8_t *palN;
+	uint8_t nPal, nPat, i, j;
+	void *m;
+
+	if (len < LTBS_HDRLEN)
+		return false;
+	for (i = 0; i < 4; i++)
+		if (sceneByte(sp + i, pgm) != (uint8_t)LTBS_MAGIC[i])
+			return false;
+	if (sceneByte(sp + 4, pgm) != LTBS_VERSION)
+		return false;
+	nPal = sceneByte(sp + 5, pgm);
+	nPat = sceneByte(sp + 6, pgm);
+	sp += LTBS_HDRLEN;
+
+	pal = (RGB **)ar.alloc(nPal * sizeof(RGB *));
+	palN = (uint8_t *)ar.alloc(nPal);
+	if (nPal && (!pal || !palN))
+		return false;
+
+	/**  palettes, copied once and shared by the patterns that use them **/
+	for (i = 0; i < nPal; i++)
+	{
+		if (sp >= send)
+			return false;
+		palN[i] = sceneByte(sp++, pgm);
+		if ((size_t)(send - sp) < palN[i] * 3u)
+			return false;
+		pal[i] = (RGB *)ar.alloc(palN[i] * sizeof(RGB));
+		if (palN[i] && !pal[i])
+			return false;
+		for (j = 0; j < palN[i]; j++, sp += 3)
+			pal[i][j] = CLR(sceneByte(sp, pgm), sceneByte(sp + 1, pgm), sceneByte(sp + 2, pgm));
+	}
+
+	/**  patterns, each followed by its actions **/
+	for (i = 0; i < nPat; i++)
+	{
+		if ((size_t)(send - sp) < LTBS_PATLEN)
+			return false;
+		uint8_t type = sceneByte(sp, pgm);
+		uint8_t pi = sceneByte(sp + 1, pgm);
+		uint8_t off = sceneByte(sp + 2, pgm);
+		uint8_t np = sceneByte(sp + 3, pgm);
+		uint16_t reps = sceneByte(sp + 4, pgm) | (sceneByte(sp + 5, pgm) << 8);
+		uint8_t on = sceneByte(sp + 6, pgm);
+		uint8_t nAct = sceneByte(sp + 7, pgm);
+		Pattern *p;
+		sp += LTBS_PATLEN;
+
+		if (pi >= nPal)
+			return false;
+		if (type == LTBS_PIXPAT)
+		{
+			if (off + np > palN[pi] || !(m = ar.alloc(sizeof(pixPat))))
+				return false;
+			p = new (m) pixPat(pal[pi] + off, np, reps, on);
+		}
+		else if (type == LTBS_RTPAT)
+		{
+			if (off + 2 > palN[pi] || reps < 2 || !(m = ar.alloc(sizeof(RTPat))))
+				return false;
+			p = new (m) RTPat(pal[pi] + off, reps, on);
+		}
+		else
+			return false;
+
+		p->setArena();
+		if (tail == NULL)
+			*head = p;
+		else
+			tail->Append(p);
+		tail = p;
+
+		for (j = 0; j < nAct; j++, sp += LTBS_ACTLEN)
+		{
+			if ((size_t)(send - sp) < LTBS_ACTLEN || sceneByte(sp, pgm) != LTBS_ACT_DIM)
+				return false;
+			uint16_t dur = sceneByte(sp + 2, pgm) | (sceneByte(sp + 3, pgm) << 8);
+			if (dur > LTBS_MAXDUR)
+				return false;
+			if (!(m = ar.alloc(sizeof(actionOnLvl))))
+				return false;
+			Action *a = new (m) actionOnLvl(p, sceneByte(sp + 1, pgm), dur);
+			a->setArena();
+			p->addAct(a);
+		}
+	}
+	return true;
+}
+
+
+void
+LTBDots::clearPats()
+{
+	freeChain(pats);
+	pats = NULL;
+	arena.reset();
+	dropStage();							// and any staged scene or fade
+	staging = false;
+	xDur = 0;
+}
+
+void
+LTBDots::freeChain(Pattern *ptr)
+{
+	// walk list and delete em.
+	Pattern *nxtp;
+
+	while (ptr)
+	{
+		nxtp = ptr->Nxt();
+		ltbFree(ptr);
+		ptr = nxtp;
+	}
+}
+
+void
+LTBDots::clearLights(RGB fill)
+{
+	clearPats();
+	addPat(&fill, 1, nPix);
+	printStrip("CLEAR");
+	showLights(true);
+	clearPats();
+}
+
+
+void
+LTBDots::showLights(bool force)
+{
+	renderFrame(force);
+	sendFrame();
+}
+
+/**
+**  This function reports the bytes held by the strip, its frames and every pattern
+**  (shown and staged), so scene loads can be checked against free RAM first.  Counts
+**  requested sizes, not allocator overhead, and not arrays owned by the caller.
+**/
+void
+LTBDots::getMemUsage(LTBMem &m)
+{
+	size_t fb = (size_t)nPix * bpp;
+
+	memset(&m, 0, sizeof(m));
+	m.strip = sizeof(*this);
+	m.frames = fb + (frame[1] != frame[0] ? fb : 0) + (xBuf ? fb : 0);
+	m.dither = dither ? (size_t)nPix * 2 : 0;
+	m.arena = arena.used() + stageArena.used();
+	for (Pattern *p = pats; p; p = p->Nxt())
+		p->memUsage(m);
+	for (Pattern *p = stage; p; p = p->Nxt())
+		p->memUsage(m);
+	m.total = m.strip + m.frames + m.dither + m.patterns + m.buffers + m.actions + m.arena;
+}
+
+/**
+**  This function adds a second frame buffer so one core (or the main loop) can run
+**  renderFrame while another core (or an ISR) runs sendFrame.  The transmitter always
+**  sends a complete frame and the renderer never waits for it.
+**/
+bool
+LTBDots::enableDoubleBuffer()
+{
+	if (frame[1] != frame[0])
+		return true;
+
+	uint8_t *b = new uint8_t[(size_t)nPix * bpp];
+	if (b == NULL)
+		return false;
+	memcpy(b, frame[0], (size_t)nPix * bpp);
+	frameLen[1] = frameLen[0];
+	frame[1] = b;
+	return true;
+}
+
+/**
+**  This function turns temporal dithering on or off.  While on, every frame is rendered
+**  and the fraction that fillRGB would drop (fader and ramp values are SCALE fixed point)
+**  is carried per pixel into the next frame, so slow fades at low levels get ~12 bits of
+**  resolution at high refresh rates.  Costs 2 bytes per pixel.
+**/
+bool
+LTBDots::setDither(bool on)
+{
+	if (!on)
+	{
+		if (dither) delete[]dither;
+		dither = NULL;
+		return true;
+	}
+	if (dither)
+		return true;
+	dither = new uint8_t[(size_t)nPix * 2];
+	if (dither == NULL)
+		return false;
+	memset(dither, 0, (size_t)nPix * 2);
+	return true;
+}
+
+/**
+**  This function sets a current budget for the strip.  Each frame's draw is estimated
+**  from the channel sums the fills accumulate, and if it is over budget the APA102
+**  global brightness field of every pixel is lowered to bring it back under.
+**  mAChan is the draw of one channel at 255, mAIdle that of a dark pixel.  0 turns it off.
+**/
+void
+LTBDots::setPowerBudget(uint16_t mA, uint8_t mAPerChan, uint8_t mAPerIdle)
+{
+	powerBudget = mA;
+	mAChan = mAPerChan;
+	mAIdle = mAPerIdle;
+}
+
+void
+LTBDots::limitPower()
+{
+	uint32_t idle = (uint32_t)nPix * mAIdle;
+
+	powerEst = idle + (frameFill.chanSum / 255) * mAChan + (frameFill.chanSum % 255) * mAChan / 255;	// no 32 bit overflow
+	powerScale = 31;
+	if (powerBudget == 0 || powerEst <= powerBudget)
+		return;
+
+	if (powerBudget > idle)
+		powerScale = ((uint32_t)(powerBudget - idle) * 31) / (powerEst - idle);
+	else
+		powerScale = 0;
+
+	if (bpp == 4)
+	{
+		uint8_t hdr = 0xe0 | powerScale;			// APA102/SK9822 global brightness field
+		for (uint8_t *p = dots; p < curStrip; p += 4)
+			*p = hdr;
+	}
+	else
+	{
+		for (uint8_t *p = dots; p < curStrip; p++)	// no brightness field, scale the channels
+			*p = (*p * powerScale) / 31;
+	}
+}
+
+/************************************************************************/
+/* Swap protocol helpers.  bufState is the only shared word; the        */
+/* transmitter only changes it while DB_READY is set and the renderer   */
+/* is the only one that sets DB_READY, so a CAS on it is enough.        */
+/************************************************************************/
+static inline uint8_t
+loadState(volatile uint8_t *s)
+{
+#if defined(__AVR__)
+	return *s;
+#else
+	return __atomic_load_n(s, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void
+storeState(volatile uint8_t *s, uint8_t val)
+{
+#if defined(__AVR__)
+	*s = val;
+#else
+	__atomic_store_n(s, val, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline bool
+casState(volatile uint8_t *s, uint8_t expect, uint8_t val)
+{
+#if defined(__AVR__)
+	bool ok;
+	uint8_t sreg = SREG;
+	cli();
+	ok = (*s == expect);
+	if (ok)
+		*s = val;
+	SREG = sreg;
+	return ok;
+#else
+	return __atomic_compare_exchange_n(s, &expect, val, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**
+**  This function switches the time source.  Restarts the delta so the switch doesn't
+**  show up as a jump.
+**/
+void
+LTBDots::setClock(DotsClock *c)
+{
+	clock = c;
+	lastMsec = clock->now();
+}
+
+bool
+LTBDots::tickActions(uint16_t deltaT)
+{
+	Pattern *ptr = pats;
+	bool changed = false;
+
+	/**  Loop through all pats and update timed actions **/
+	while (ptr)
+	{
+		if (ptr->doActions(deltaT))
+			changed = true;
+		ptr = ptr->Nxt();
+	}
+	for (ptr = xDur ? stage : NULL; ptr; ptr = ptr->Nxt())		// the incoming scene animates too
+		ptr->doActions(deltaT);
+	return changed;
+}
+
+/**
+**  This function fills a pattern chain into dst, dithered when dith is set, and returns
+**  the end of what was filled.
+**/
+uint8_t *
+LTBDots::fillChain(Pattern *ptr, uint8_t *dst, uint8_t *dith, LTBFill &f)
+{
+	uint16_t from = 0;
+
+	return fillRun(ptr, from, dst, dst, dith, nPix, f);
+}
+
+/**
+**  This function fills up to max pixels of a pattern chain into the frame at base,
+**  carrying on at dst with pixel from of pattern cur, and leaves cur and from where it
+**  stopped.  cur is NULL once the chain is done or the frame is full; patterns past
+**  the end of the strip aren't filled.  dith is the frame's dither error, or NULL.
+**/
+uint8_t *
+LTBDots::fillRun(Pattern *&cur, uint16_t &from, uint8_t *base, uint8_t *dst, uint8_t *dith, uint16_t max, LTBFill &f)
+{
+	uint16_t room = nPix - (dst - base) / bpp;
+
+	if (max > room)
+		max = room;
+	while (cur && max)
+	{
+		uint16_t len = cur->pixLen();
+		uint16_t n = from < len ? len - from : 0;
+		uint8_t *q;
+
+		if (n > max)
+			n = max;
+		if (dith)
+			q = cur->fillRGBDither(dst, dith + (dst - base) / bpp * 2, f, from, n);
+		else
+			q = cur->fillRGB(dst, f, from, n);
+		uint16_t got = (q - dst) / bpp;
+		dst = q;
+		max -= got;
+		from += got;
+		if (got < n || from >= len)			// done, or filled less than it said it would
+		{
+			cur = cur->Nxt();
+			from = 0;
+		}
+	}
+	if (dst == base + (size_t)nPix * bpp)
+		cur = NULL;
+	return dst;
+}
+
+/************************************************************************/
+/* This function blanks pixels from p to end, header byte kept valid    */
+/************************************************************************/
+static void
+blankPix(uint8_t *p, uint8_t *end, uint8_t bpp)
+{
+	for (; p < end; p += bpp)
+	{
+		memset(p, 0, bpp);
+		if (bpp == 4)
+			p[0] = 0xff;
+	}
+}
+
+/**
+**  This function fills the staged scene into xBuf and blends it into dots, which holds
+**  the scene on show.  The wire headers match, so the blend runs over raw frame bytes.
+**  showStep does the same steps a slice at a time.
+**/
+void
+LTBDots::blendFade()
+{
+	xEnd = fillChain(stage, xBuf, NULL, xFill);
+	padFade();
+	blendRun(dots, curStrip - dots);
+	endBlend();
+}
+
+/**  pads the shorter of the two scenes with black, once both are filled **/
+void
+LTBDots::padFade()
+{
+	if (xEnd - xBuf > curStrip - dots)
+	{
+		blankPix(curStrip, dots + (xEnd - xBuf), bpp);
+		curStrip = dots + (xEnd - xBuf);
+	}
+	else
+		blankPix(xEnd, xBuf + (curStrip - dots), bpp);
+}
+
+/**  blends n bytes of dots from p toward xBuf by xT/256, returns where it stopped **/
+uint8_t *
+LTBDots::blendRun(uint8_t *p, size_t n)
+{
+	uint8_t *q = xBuf + (p - dots), *end = p + n;
+
+	for (; p < end; p++, q++)
+		*p = lerp8(*p, *q, xT);
+	return p;
+}
+
+void
+LTBDots::endBlend()
+{
+	frameFill.chanSum = (frameFill.chanSum >> 8) * (256 - xT) + (xFill.chanSum >> 8) * xT;	// estimate, kept in 32 bits
+}
+
+/**
+**  Renderer side: run actions and, if anything changed, fill the back frame and publish
+**  it.  Returns true if a frame was published.
+**/
+bool
+LTBDots::renderFrame(bool force)
+{
+	if (!tick(force))
+		return false;
+
+	beginFill();
+	if (xDur)
+	{
+		curStrip = fillChain(pats, dots, NULL, frameFill);
+		blendFade();
+	}
+	else
+		curStrip = fillChain(pats, dots, dither, frameFill);
+	endFill();
+	return true;
+}
+
+/**
+**  This function advances effect time and runs the actions.  Returns true when a new
+**  frame needs to be filled.
+**/
+bool
+LTBDots::tick(bool force)
+{
+	bool changed = false;
+	uint32_t now = clock->now();
+	uint32_t real = now - lastMsec;			// 32 bit, so long stalls don't wrap
+	lastMsec = now;
+
+	/**  scale by speed in 64k msec pieces, carrying the fraction so nothing drifts **/
+	while (real && !paused)
+	{
+		uint16_t piece = real > 0xffff ? 0xffff : real;
+		uint32_t scaled = (uint32_t)piece * speed + speedRem;
+		real -= piece;
+		speedRem = scaled & 0xff;
+		scaled >>= 8;
+		simMsec += scaled;
+
+		if (tStep)
+		{
+			tAccum += scaled;
+			if (tAccum > (uint32_t)tStep * TIME_MAXSTEPS)	// after a stall, drop what can't be caught up
+				tAccum = (uint32_t)tStep * TIME_MAXSTEPS;
+			while (tAccum >= tStep)				// catch up in whole steps
+			{
+				tAccum -= tStep;
+				if (tickActions(tStep))
+					changed = true;
+			}
+		}
+		else
+		{
+			while (scaled)
+			{
+				uint16_t dt = scaled > 0xffff ? 0xffff : scaled;
+				scaled -= dt;
+				if (tickActions(dt))
+					changed = true;
+			}
+		}
+	}
+
+	if (xDur && simMsec - xStart >= xDur)
+	{
+		endFade();
+		changed = true;
+	}
+	return changed || force || dither || xDur;	// dithered frames differ every time
+}
+
+void
+LTBDots::beginFill()
+{
+	claimFrame();
+	frameFill.chanSum = 0;
+	if (xDur)
+	{
+		uint32_t t = ((simMsec - xStart) * 256) / xDur;	// < 256, endFade runs at the end
+		xT = t > 255 ? 255 : t;
+		xFill.chanSum = 0;
+	}
+}
+
+void
+LTBDots::endFill()
+{
+	limitPower();
+	publishFrame(curStrip - dots);
+}
+
+/**
+**  This function does the next slice of showLights: at most maxPix pixels of filling,
+**  blending or sending, or maxUsec of work (0 for no limit on either), then returns so
+**  the main loop can get on with other things.  Returns true when the call finished a
+**  frame.  Filling stops mid-pattern and carries on at the same pixel next call, so
+**  long patterns and cross-fades are sliced too; with only a time limit the work goes
+**  in RS_CHUNK pixel pieces.  Don't mix with showLights mid-frame.
+**/
+bool
+LTBDots::showStep(uint16_t maxPix, uint16_t maxUsec, bool force)
+{
+	uint32_t t0 = micros();
+	uint16_t done = 0;				// pixels of work in this call
+	uint16_t slice;
+	uint8_t *p;
+	size_t n;
+
+	for (;;)
+	{
+		slice = maxPix ? maxPix - done : RS_CHUNK;
+		switch (rState)
+		{
+		case RS_IDLE:
+			if (tick(force))
+			{
+				beginFill();
+				rCursor = pats;
+				rFrom = 0;
+				rFade = xDur != 0;			// a fade started mid-frame waits for the next
+				rState = RS_FILL;
+			}
+			else
+				rState = RS_SEND;			// nothing changed, resend the front frame
+			break;
+
+		case RS_FILL:
+			p = curStrip;
+			curStrip = fillRun(rCursor, rFrom, dots, curStrip, rFade ? NULL : dither, slice, frameFill);
+			done += (curStrip - p) / bpp;
+			if (rCursor)
+				break;
+			if (rFade)
+			{
+				rCursor = stage;
+				rFrom = 0;
+				xEnd = xBuf;
+				rState = RS_XFILL;
+			}
+			else
+			{
+				endFill();
+				rState = RS_SEND;
+			}
+			break;
+
+		case RS_XFILL:
+			p = xEnd;
+			xEnd = fillRun(rCursor, rFrom, xBuf, xEnd, NULL, slice, xFill);
+			done += (xEnd - p) / bpp;
+			if (rCursor == NULL)
+			{
+				padFade();
+				xPos = dots;
+				rState = RS_BLEND;
+			}
+			break;
+
+		case RS_BLEND:
+			n = (size_t)slice * bpp;
+			if (n > (size_t)(curStrip - xPos))
+				n = curStrip - xPos;
+			xPos = blendRun(xPos, n);
+			done += n / bpp;
+			if (xPos == curStrip)
+			{
+				endBlend();
+				endFill();
+				rState = RS_SEND;
+			}
+			break;
+
+		case RS_SEND:
+			txFresh = beginSend();
+			rState = RS_SENDING;
+			break;
+
+		case RS_SENDING:
+			n = (size_t)slice * bpp;
+			if (n > (size_t)(txEnd - dp))
+				n = txEnd - dp;
+			if (n)
+				out->write(dp, n);
+			dp += n;
+			done += n / bpp;
+			if (dp == txEnd)
+			{
+				endSend(txFresh);
+				rState = RS_IDLE;
+				return true;
+			}
+			break;
+		}
+		if ((maxPix && done >= maxPix) || (maxUsec && micros() - t0 >= maxUsec))
+			return false;
+	}
+}
+
+/************************************************************************/
+/* This function hashes a frame with Fletcher-32, so that moving bytes  */
+/* around changes it as well as changing their values.  The sums are    */
+/* mod 65535, kept in 16 bits with an end around carry                  */
+/************************************************************************/
+static uint32_t
+hashFrame(const uint8_t *p, size_t n)
+{
+	uint16_t s1 = 0, s2 = 0;
+
+	while (n--)
+	{
+		uint8_t b = *p++;
+		s1 += b;
+		s1 += s1 < b;
+		s2 += s1;
+		s2 += s2 < s1;
+	}
+	return ((uint32_t)s2 << 16) | s1;
+}
+
+/**
+**  This function claims the back frame for writing and returns it (also left in dots).
+**  A frame published earlier that the transmitter has not picked up yet is taken back
+**  and will be overwritten (counted as dropped).  Used by renderFrame, and by anything
+**  that writes pixels straight into the frame such as LTBIngest.
+**/
+uint8_t *
+LTBDots::claimFrame()
+{
+	uint8_t s = loadState(&bufState);
+
+	if ((s & DB_READY) && casState(&bufState, s, s & ~DB_READY))
+		stats.dropped++;
+	backIdx = (loadState(&bufState) & DB_FRONT) ^ 1;
+	if (frame[0] == frame[1])
+		backIdx = 0;
+	dots = curStrip = frame[backIdx];
+	return dots;
+}
+
+/**
+**  This function publishes len bytes of the claimed frame to sendFrame.  The transmitter
+**  can't touch bufState while DB_READY is clear, so a plain store is enough.
+**  With setFrameSkip on, the frame is hashed here in a pass of its own rather than in
+**  the fill kernels: pixPat copies its periods with memcpy, sparkles add into bytes
+**  already written, the power limit and a cross-fade rewrite the frame after the fills,
+**  and LTBIngest writes frames with no fill at all.  Only the finished bytes give a
+**  hash that matches the wire.
+**/
+void
+LTBDots::publishFrame(size_t len)
+{
+	frameLen[backIdx] = len;
+	if (skipSame)
+		frameHash[backIdx] = hashFrame(frame[backIdx], len);
+	stats.rendered++;
+	storeState(&bufState, loadState(&bufState) | DB_READY);
+}
+
+/**
+**  This function publishes a frame written straight into claimFrame's buffer, as
+**  LTBIngest does, running the power limit on chanSum, the sum of its channel bytes.
+**/
+void
+LTBDots::publishFrame(size_t len, uint32_t chanSum)
+{
+	frameFill.chanSum = chanSum;
+	curStrip = dots + len;
+	limitPower();
+	publishFrame(len);
+}
+
+/**
+**  Transmitter side: take the newest published frame if there is one, otherwise resend
+**  the last one.  Safe to call from an ISR or the other core.  Returns true if a new
+**  frame went out.
+**/
+bool
+LTBDots::sendFrame()
+{
+	bool fresh = beginSend();
+
+	if (dp != txEnd)
+		out->write(dp, txEnd - dp);
+	dp = txEnd;
+	endSend(fresh);
+	return fresh;
+}
+
+/**
+**  This function turns on skipping sends whose frame matches the one last sent, as
+**  told by a hash taken when the frame is published.  An unchanged frame still goes
+**  out every keepaliveMs so a strip that glitched or was plugged in late catches up,
+**  and so a changed frame whose hash collides with the last is held back no longer
+**  than that.  Returns false, leaving skipping off, if keepaliveMs is 0.
+**/
+bool
+LTBDots::setFrameSkip(bool on, uint16_t keepaliveMs)
+{
+	bool ok = !on || keepaliveMs != 0;
+
+	skipSame = on && ok;
+	keepalive = keepaliveMs;
+	sentValid = false;
+	frameHash[0] = hashFrame(frame[0], frameLen[0]);
+	frameHash[1] = hashFrame(frame[1], frameLen[1]);
+	return ok;
+}
+
+uint8_t
+LTBDots::getSkipPct()
+{
+	uint32_t all = stats.sent + stats.repeated + stats.skipped;
+	uint32_t skip = stats.skipped;
+
+	while (all > 0xffffffffUL / 100)			// keep skip * 100 in 32 bits
+	{
+		all >>= 1;
+		skip >>= 1;
+	}
+	return all ? (uint8_t)((skip * 100) / all) : 0;
+}
+
+/**
+**  This function picks up a newly published frame if there is one (else the previous
+**  frame goes again) and sends the leader.  The pixels to send run from dp to txEnd.
+**/
+bool
+LTBDots::beginSend()
+{
+	uint8_t s = loadState(&bufState);
+	bool fresh = false;
+
+	if ((s & DB_READY) && casState(&bufState, s, (frame[0] == frame[1] ? s : s ^ DB_FRONT) & ~DB_READY))
+		fresh = true;
+
+	s = loadState(&bufState) & DB_FRONT;
+	if (frame[0] == frame[1])
+		s = 0;
+	dp = frame[s];
+	txEnd = dp + frameLen[s];
+
+	txSkip = false;
+	if (skipSame)
+	{
+		uint32_t now = clock->now();
+		if (sentValid && frameHash[s] == sentHash && frameLen[s] == sentLen &&
+			now - sentMsec < keepalive)
+		{
+			txSkip = true;
+			dp = txEnd;								// nothing to send
+			return fresh;
+		}
+		sentHash = frameHash[s];
+		sentLen = frameLen[s];
+		sentMsec = now;
+		sentValid = true;
+	}
+	sendLeader();
+	return fresh;
+}
+
+void
+LTBDots::endSend(bool fresh)
+{
+	if (txSkip)
+	{
+		stats.skipped++;
+		return;
+	}
+	sendTrailer();
+	out->endFrame();
+
+	if (fresh)
+		stats.sent++;
+	else
+		stats.repeated++;
+}
+
+
+uint8_t *
+pixPat::fillRGB(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillT, p, f, from, n);
+
+/*
+	uint8_t *addr = (uint8_t *)color;
+	uint8_t curbyte;
+	uint8_t bitCnt;
+	Serial.print("buff adder to fill: 0x"); Serial.println((uint16_t)p, HEX);
+
+	asm volatile(
+		"	push r0						\n\t"		//
+		"	push r1						\n\t"		//
+		"	adiw %[repCnt], 0			\n\t"		// just return if count is zero	
+		"	breq alldone%=				\n\t"		//
+
+		"nextPass%=:					\n\t"
 		"	tst %[pixCnt]				\n\t"		// just return if count is zero
 		"	breq alldone%=				\n\t"		//
 
@@ -859,8 +2062,16 @@ pixPat::fillRGB(uint8_t *p)
 
 
 uint8_t *
-RTPat::fillRGB(uint8_t *p)
+pixPat::fillRGBDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
 {
+	return FILL_FMT(f.fmt, fillDitherT, p, err, f, from, n);
+}
+
+
+uint8_t *
+RTPat::fillRGB(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillT, p, f, from, n);
 /*
 uint8_t bitCnt;
 	uint8_t curbyte;
@@ -923,21 +2134,334 @@ uint8_t bitCnt;
 		[pct]		"a"		(onLvl)
 		);
 */
-	return p;
+}
+
+uint8_t *
+RTPat::fillRGBDither(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillDitherT, p, err, f, from, n);
+}
+
+/**
+**  Start frame: 32 zero bits for APA102/SK9822.  WS2801 has none, it latches when
+**  the clock idles.
+**/
+uint16_t
+LTBDots::leaderLen()
+{
+	return bpp == 4 ? 4 : 0;
+}
+
+/**
+**  End frame: each APA102 pixel delays the clock it forwards by half a cycle, so the
+**  data needs nPix/2 more clock edges to reach the last pixel, ceil(nPix / 16) bytes.
+**  SK9822 only latches new data on a 32 bit reset frame, which goes first.
+**/
+uint16_t
+LTBDots::trailerLen()
+{
+	uint16_t n = (nPix >> 4) + ((nPix & 0x0f) != 0);
+
+	if (pixFmt == PIX_SK9822)
+		return n + 4;
+	if (pixFmt == PIX_WS2801)
+		return 0;
+	return n;
 }
 
 void
 LTBDots::sendTrailer()
 {
-	uint8_t numbytes = (nPix >> 4) + 1;
-
-	while (numbytes--)
-		SPI.transfer(0);
+	out->zeros(trailerLen());
 }
 
 void
 LTBDots::sendLeader(void)
 {
-	for (int i = 0; i < 4; i++)
-		SPI.transfer(0);
+	out->zeros(leaderLen());
+}
+
+
+//
+/*** procedural patterns *****/
+//
+
+/************************************************************************/
+/* This function returns 2D value noise at SCALE fixed point (x, z)     */
+/************************************************************************/
+uint8_t
+noise8(uint16_t x, uint16_t z)
+{
+	uint8_t xi = x >> SCALE, zi = z >> SCALE;
+	uint8_t fz = fade8(z & 0xff), fx = fade8(x & 0xff);
+	uint8_t c0 = lerp8(noiseHash(xi, zi), noiseHash(xi, zi + 1), fz);
+	uint8_t c1 = lerp8(noiseHash(xi + 1, zi), noiseHash(xi + 1, zi + 1), fz);
+	return lerp8(c0, c1, fx);
+}
+
+static inline uint8_t
+scale8(uint8_t a, uint8_t b)
+{
+	return ((uint16_t)a * (b + 1)) >> 8;		// b = 255 leaves a unchanged
+}
+
+/************************************************************************/
+/* This function converts hue/saturation/value, all 0-255, to RGB       */
+/* with integer math: 6 sectors of the hue wheel, each a linear ramp    */
+/************************************************************************/
+RGB
+hsvRGB(uint8_t h, uint8_t s, uint8_t v)
+{
+	uint16_t h6 = (uint16_t)h * 6;
+	uint8_t f = h6 & 0xff;						// position within the sector
+	uint8_t lo = scale8(v, 255 - s);
+	uint8_t dn = scale8(v, 255 - scale8(s, f));
+	uint8_t up = scale8(v, 255 - scale8(s, 255 - f));
+
+	switch (h6 >> 8)
+	{
+	case 0:		return CLR(v, up, lo);
+	case 1:		return CLR(dn, v, lo);
+	case 2:		return CLR(lo, v, up);
+	case 3:		return CLR(lo, dn, v);
+	case 4:		return CLR(up, lo, v);
+	default:	return CLR(v, lo, dn);
+	}
+}
+
+static RGB palWhite[1] = { CLR(255, 255, 255) };	// stands in for an empty palette
+
+/************************************************************************/
+/* This function maps 0-255 onto a palette, interpolating between       */
+/* entries.  A single entry palette is scaled by v instead              */
+/************************************************************************/
+RGB
+palRGB(RGB *pal, uint8_t npal, uint8_t v)
+{
+	RGB c;
+
+	if (pal == NULL || npal == 0)
+		return CLR(v, v, v);					// nothing to index, grey scale
+	if (npal < 2)
+	{
+		c.r = ((uint16_t)pal[0].r * v) >> 8;
+		c.g = ((uint16_t)pal[0].g * v) >> 8;
+		c.b = ((uint16_t)pal[0].b * v) >> 8;
+		return c;
+	}
+	uint16_t pos = (uint16_t)v * (npal - 1);
+	uint8_t i = pos >> 8, t = pos & 0xff;
+	RGB a = pal[i], b = pal[i + (t != 0)];
+	c.r = lerp8(a.r, b.r, t);
+	c.g = lerp8(a.g, b.g, t);
+	c.b = lerp8(a.b, b.b, t);
+	return c;
+}
+
+noisePat::noisePat(RGB *pal, uint8_t npal, uint16_t npix, uint16_t scl, uint16_t spd, uint8_t onlvl) :Pattern(onlvl)
+{
+	setPalette(pal, npal);
+	numReps = npix;
+	scale = scl;
+	speed = spd;
+	z = zRem = 0;
+}
+
+void
+noisePat::setPalette(RGB *pal, uint8_t npal)
+{
+	if (pal == NULL || npal == 0)
+	{
+		pal = palWhite;
+		npal = 1;
+	}
+	color = pal;
+	numPix = npal;
+}
+
+void
+noisePat::memUsage(LTBMem &m)
+{
+	m.patterns += sizeof(*this);
+	Pattern::memUsage(m);
+}
+
+bool
+noisePat::advance(uint16_t deltaT)
+{
+	uint32_t acc = (uint32_t)speed * deltaT + zRem;
+	uint16_t dz = acc / 1000;
+
+	zRem = acc - (uint32_t)dz * 1000;
+	z += dz;
+	return dz != 0;
+}
+
+uint8_t *
+noisePat::fillRGB(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillT, p, f, from, n);
+}
+
+
+sparklePat::sparklePat(Pattern *back, uint16_t npix, uint8_t cp, RGB *pal, uint8_t npal, uint8_t onlvl) :Pattern(onlvl)
+{
+	bg = back;
+	if (pal == NULL || npal == 0)
+	{
+		pal = palWhite;							// spawn would index an empty palette
+		npal = 1;
+	}
+	color = pal;
+	numPix = npal;
+	numReps = npix;
+	cap = cp;
+	nAct = 0;
+
+	uint8_t *blk = new uint8_t[cap * 10];		// one block, 10 bytes per particle
+	pix = (uint16_t *)blk;
+	vel = (int16_t *)(blk + cap * 2);
+	life = (uint16_t *)(blk + cap * 4);
+	rem = (int16_t *)(blk + cap * 6);
+	frac = blk + cap * 8;
+	clr = blk + cap * 9;
+
+	setSpawn(4, 500, 0);
+}
+
+sparklePat::~sparklePat()
+{
+	delete[](uint8_t *)pix;
+	numReps = 0;
+}
+
+void
+sparklePat::memUsage(LTBMem &m)
+{
+	m.patterns += sizeof(*this);
+	m.buffers += (size_t)cap * 10;						// the pool block, bg is the caller's
+	Pattern::memUsage(m);
+}
+
+void
+sparklePat::setSpawn(uint16_t perSec, uint16_t lifeMs, int16_t maxV)
+{
+	rate = perSec;
+	rateRem = 0;
+	decay = lifeMs ? 0xffffu / lifeMs : 0xffffu;
+	if (decay == 0)
+		decay = 1;
+	maxVel = maxV;
+}
+
+bool
+sparklePat::spawn(uint16_t at, int16_t v, uint8_t c)
+{
+	if (nAct == cap || at >= numReps)
+		return false;
+	pix[nAct] = at;
+	frac[nAct] = 0x80;
+	rem[nAct] = 0;
+	vel[nAct] = v;
+	life[nAct] = 0xffff;
+	clr[nAct] = c < numPix ? c : 0;
+	nAct++;
+	return true;
+}
+
+/************************************************************************/
+/* This function removes particle i by moving the last live one into    */
+/* its slot, keeping the live particles packed                          */
+/************************************************************************/
+void
+sparklePat::kill(uint8_t i)
+{
+	nAct--;
+	pix[i] = pix[nAct];
+	frac[i] = frac[nAct];
+	rem[i] = rem[nAct];
+	vel[i] = vel[nAct];
+	life[i] = life[nAct];
+	clr[i] = clr[nAct];
+}
+
+bool
+sparklePat::advance(uint16_t deltaT)
+{
+	bool changed = nAct != 0;
+	uint32_t fade = (uint32_t)decay * deltaT;
+
+	/**  move and fade the live particles **/
+	for (uint8_t i = 0; i < nAct; )
+	{
+		int32_t mv = (int32_t)vel[i] * deltaT + rem[i];		// carry the remainder, or slow ones never move
+		int32_t at = ((int32_t)pix[i] << 8 | frac[i]) + mv / 1000;
+		if (life[i] <= fade || at < 0 || (at >> 8) >= numReps)
+		{
+			kill(i);						// slot i now holds another particle, look again
+			continue;
+		}
+		life[i] -= fade;
+		rem[i] = mv % 1000;
+		pix[i] = at >> 8;
+		frac[i] = at & 0xff;
+		i++;
+	}
+
+	/**  spawn new ones **/
+	uint32_t acc = (uint32_t)rate * deltaT + rateRem;
+	uint16_t n = acc / 1000;
+	rateRem = acc - (uint32_t)n * 1000;
+	while (n--)
+	{
+		int16_t v = maxVel ? random(-maxVel, maxVel + 1) : 0;
+		if (!spawn(random(numReps), v, random(numPix)))
+			break;
+		changed = true;
+	}
+	return changed;
+}
+
+uint8_t *
+sparklePat::fillRGB(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillT, p, f, from, n);
+}
+
+
+huePat::huePat(uint16_t npix, uint16_t stp, int16_t spd, uint8_t s, uint8_t v, uint8_t onlvl) :Pattern(onlvl)
+{
+	color = NULL;
+	numPix = 0;
+	numReps = npix;
+	hue = 0;
+	step = stp;
+	speed = spd;
+	hueRem = 0;
+	sat = s;
+	val = v;
+}
+
+bool
+huePat::advance(uint16_t deltaT)
+{
+	int32_t acc = (int32_t)speed * deltaT + hueRem;
+	int16_t dh = acc / 1000;
+
+	hueRem = acc - (int32_t)dh * 1000;
+	hue += dh;
+	return dh != 0;
+}
+
+uint8_t *
+huePat::fillRGB(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillT, p, f, from, n);
+}
+
+void
+huePat::memUsage(LTBMem &m)
+{
+	m.patterns += sizeof(*this);
+	Pattern::memUsage(m);
 }
@@ -0,0 +1,312 @@
+/*!
+* \file LTBMatrix.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* 2D panel mapping, drawing and a 5x7 font for matrixPat
+*/
+
+#include "LTBMatrix.h"
+
+/************************************************************************/
+/* 5x7 font, printable ASCII, one byte per column, bit 0 at the top     */
+/************************************************************************/
+static const uint8_t font5x7[95 * MX_FONTW] PROGMEM = {
+	0x00, 0x00, 0x00, 0x00, 0x00,		//  
+	0x00, 0x00, 0x5f, 0x00, 0x00,		// !
+	0x00, 0x07, 0x00, 0x07, 0x00,		// "
+	0x14, 0x7f, 0x14, 0x7f, 0x14,		// #
+	0x24, 0x2a, 0x7f, 0x2a, 0x12,		// $
+	0x23, 0x13, 0x08, 0x64, 0x62,		// %
+	0x36, 0x49, 0x56, 0x20, 0x50,		// &
+	0x00, 0x08, 0x07, 0x03, 0x00,		// '
+	0x00, 0x1c, 0x22, 0x41, 0x00,		// (
+	0x00, 0x41, 0x22, 0x1c, 0x00,		// )
+	0x2a, 0x1c, 0x7f, 0x1c, 0x2a,		// *
+	0x08, 0x08, 0x3e, 0x08, 0x08,		// +
+	0x00, 0x80, 0x70, 0x30, 0x00,		// ,
+	0x08, 0x08, 0x08, 0x08, 0x08,		// -
+	0x00, 0x00, 0x60, 0x60, 0x00,		// .
+	0x20, 0x10, 0x08, 0x04, 0x02,		// /
+	0x3e, 0x51, 0x49, 0x45, 0x3e,		// 0
+	0x00, 0x42, 0x7f, 0x40, 0x00,		// 1
+	0x72, 0x49, 0x49, 0x49, 0x46,		// 2
+	0x21, 0x41, 0x49, 0x4d, 0x33,		// 3
+	0x18, 0x14, 0x12, 0x7f, 0x10,		// 4
+	0x27, 0x45, 0x45, 0x45, 0x39,		// 5
+	0x3c, 0x4a, 0x49, 0x49, 0x31,		// 6
+	0x41, 0x21, 0x11, 0x09, 0x07,		// 7
+	0x36, 0x49, 0x49, 0x49, 0x36,		// 8
+	0x46, 0x49, 0x49, 0x29, 0x1e,		// 9
+	0x00, 0x00, 0x14, 0x00, 0x00,		// :
+	0x00, 0x40, 0x34, 0x00, 0x00,		// ;
+	0x00, 0x08, 0x14, 0x22, 0x41,		// <
+	0x14, 0x14, 0x14, 0x14, 0x14,		// =
+	0x00, 0x41, 0x22, 0x14, 0x08,		// >
+	0x02, 0x01, 0x59, 0x09, 0x06,		// ?
+	0x3e, 0x41, 0x5d, 0x59, 0x4e,		// @
+	0x7c, 0x12, 0x11, 0x12, 0x7c,		// A
+	0x7f, 0x49, 0x49, 0x49, 0x36,		// B
+	0x3e, 0x41, 0x41, 0x41, 0x22,		// C
+	0x7f, 0x41, 0x41, 0x41, 0x3e,		// D
+	0x7f, 0x49, 0x49, 0x49, 0x41,		// E
+	0x7f, 0x09, 0x09, 0x09, 0x01,		// F
+	0x3e, 0x41, 0x41, 0x51, 0x73,		// G
+	0x7f, 0x08, 0x08, 0x08, 0x7f,		// H
+	0x00, 0x41, 0x7f, 0x41, 0x00,		// I
+	0x20, 0x40, 0x41, 0x3f, 0x01,		// J
+	0x7f, 0x08, 0x14, 0x22, 0x41,		// K
+	0x7f, 0x40, 0x40, 0x40, 0x40,		// L
+	0x7f, 0x02, 0x1c, 0x02, 0x7f,		// M
+	0x7f, 0x04, 0x08, 0x10, 0x7f,		// N
+	0x3e, 0x41, 0x41, 0x41, 0x3e,		// O
+	0x7f, 0x09, 0x09, 0x09, 0x06,		// P
+	0x3e, 0x41, 0x51, 0x21, 0x5e,		// Q
+	0x7f, 0x09, 0x19, 0x29, 0x46,		// R
+	0x26, 0x49, 0x49, 0x49, 0x32,		// S
+	0x03, 0x01, 0x7f, 0x01, 0x03,		// T
+	0x3f, 0x40, 0x40, 0x40, 0x3f,		// U
+	0x1f, 0x20, 0x40, 0x20, 0x1f,		// V
+	0x3f, 0x40, 0x38, 0x40, 0x3f,		// W
+	0x63, 0x14, 0x08, 0x14, 0x63,		// X
+	0x03, 0x04, 0x78, 0x04, 0x03,		// Y
+	0x61, 0x59, 0x49, 0x4d, 0x43,		// Z
+	0x00, 0x7f, 0x41, 0x41, 0x41,		// [
+	0x02, 0x04, 0x08, 0x10, 0x20,		// backslash
+	0x00, 0x41, 0x41, 0x41, 0x7f,		// ]
+	0x04, 0x02, 0x01, 0x02, 0x04,		// ^
+	0x40, 0x40, 0x40, 0x40, 0x40,		// _
+	0x00, 0x03, 0x07, 0x08, 0x00,		// `
+	0x20, 0x54, 0x54, 0x78, 0x40,		// a
+	0x7f, 0x28, 0x44, 0x44, 0x38,		// b
+	0x38, 0x44, 0x44, 0x44, 0x28,		// c
+	0x38, 0x44, 0x44, 0x28, 0x7f,		// d
+	0x38, 0x54, 0x54, 0x54, 0x18,		// e
+	0x00, 0x08, 0x7e, 0x09, 0x02,		// f
+	0x18, 0xa4, 0xa4, 0x9c, 0x78,		// g
+	0x7f, 0x08, 0x04, 0x04, 0x78,		// h
+	0x00, 0x44, 0x7d, 0x40, 0x00,		// i
+	0x20, 0x40, 0x40, 0x3d, 0x00,		// j
+	0x7f, 0x10, 0x28, 0x44, 0x00,		// k
+	0x00, 0x41, 0x7f, 0x40, 0x00,		// l
+	0x7c, 0x04, 0x78, 0x04, 0x78,		// m
+	0x7c, 0x08, 0x04, 0x04, 0x78,		// n
+	0x38, 0x44, 0x44, 0x44, 0x38,		// o
+	0xfc, 0x18, 0x24, 0x24, 0x18,		// p
+	0x18, 0x24, 0x24, 0x18, 0xfc,		// q
+	0x7c, 0x08, 0x04, 0x04, 0x08,		// r
+	0x48, 0x54, 0x54, 0x54, 0x24,		// s
+	0x04, 0x04, 0x3f, 0x44, 0x24,		// t
+	0x3c, 0x40, 0x40, 0x20, 0x7c,		// u
+	0x1c, 0x20, 0x40, 0x20, 0x1c,		// v
+	0x3c, 0x40, 0x30, 0x40, 0x3c,		// w
+	0x44, 0x28, 0x10, 0x28, 0x44,		// x
+	0x4c, 0x90, 0x90, 0x90, 0x7c,		// y
+	0x44, 0x64, 0x54, 0x4c, 0x44,		// z
+	0x00, 0x08, 0x36, 0x41, 0x00,		// {
+	0x00, 0x00, 0x77, 0x00, 0x00,		// |
+	0x00, 0x41, 0x36, 0x08, 0x00,		// }
+	0x02, 0x01, 0x02, 0x04, 0x02,		// ~
+};
+
+
+matrixPat::matrixPat(uint8_t pw, uint8_t ph, uint8_t flags, uint8_t onlvl) :Pattern(onlvl)
+{
+	uint16_t n = (uint16_t)pw * ph;
+
+	color = NULL;
+	numPix = 0;
+	numReps = n;
+	cnv = new RGB[n];
+	map = new uint16_t[n];
+	memset(cnv, 0, n * sizeof(RGB));
+	buildMap(pw, ph, flags);
+	dirty = true;
+	animate();
+}
+
+matrixPat::~matrixPat()
+{
+	delete[]cnv;
+	delete[]map;
+	numReps = 0;
+}
+
+/**
+**  This function works out, for each pixel along the wire, which canvas pixel it shows.
+**  Wire position -> panel x, y (direction, serpentine, flips) -> logical x, y (rotation).
+**/
+void
+matrixPat::buildMap(uint8_t pw, uint8_t ph, uint8_t flags)
+{
+	uint8_t rot = flags & MX_ROTMASK;
+	uint8_t px, py, x, y;
+
+	w = (rot == MX_ROT90 || rot == MX_ROT270) ? ph : pw;
+	h = (rot == MX_ROT90 || rot == MX_ROT270) ? pw : ph;
+
+	for (uint16_t i = 0; i < numReps; i++)
+	{
+		if (flags & MX_COLUMNS)
+		{
+			px = i / ph;
+			py = i % ph;
+			if ((flags & MX_SERPENTINE) && (px & 1))
+				py = ph - 1 - py;
+		}
+		else
+		{
+			py = i / pw;
+			px = i % pw;
+			if ((flags & MX_SERPENTINE) && (py & 1))
+				px = pw - 1 - px;
+		}
+		if (flags & MX_FLIPX)
+			px = pw - 1 - px;
+		if (flags & MX_FLIPY)
+			py = ph - 1 - py;
+
+		switch (rot)
+		{
+		case MX_ROT90:	x = ph - 1 - py;	y = px;				break;
+		case MX_ROT180:	x = pw - 1 - px;	y = ph - 1 - py;	break;
+		case MX_ROT270:	x = py;				y = pw - 1 - px;	break;
+		default:		x = px;				y = py;				break;
+		}
+		map[i] = index(x, y);
+	}
+}
+
+void
+matrixPat::setPix(int16_t x, int16_t y, RGB c)
+{
+	if (x < 0 || y < 0 || x >= w || y >= h)
+		return;
+	cnv[index(x, y)] = c;
+	dirty = true;
+}
+
+RGB
+matrixPat::getPix(int16_t x, int16_t y)
+{
+	if (x < 0 || y < 0 || x >= w || y >= h)
+		return CLR(0, 0, 0);
+	return cnv[index(x, y)];
+}
+
+void
+matrixPat::fill(RGB c)
+{
+	for (uint16_t i = 0; i < numReps; i++)
+		cnv[i] = c;
+	dirty = true;
+}
+
+/************************************************************************/
+/* Bresenham line, clipped per pixel                                    */
+/************************************************************************/
+void
+matrixPat::line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, RGB c)
+{
+	int16_t dx = x1 > x0 ? x1 - x0 : x0 - x1;
+	int16_t dy = y1 > y0 ? y0 - y1 : y1 - y0;
+	int8_t sx = x0 < x1 ? 1 : -1;
+	int8_t sy = y0 < y1 ? 1 : -1;
+	int16_t err = dx + dy;
+
+	for (;;)
+	{
+		setPix(x0, y0, c);
+		if (x0 == x1 && y0 == y1)
+			break;
+		int16_t e2 = 2 * err;
+		if (e2 >= dy)
+		{
+			err += dy;
+			x0 += sx;
+		}
+		if (e2 <= dx)
+		{
+			err += dx;
+			y0 += sy;
+		}
+	}
+}
+
+/**
+**  This function copies a bw x bh row major bitmap with its top left at x, y, clipped
+**  to the canvas.  Set pgm if bmp is in PROGMEM.
+**/
+void
+matrixPat::blit(const RGB *bmp, uint8_t bw, uint8_t bh, int16_t x, int16_t y, bool pgm)
+{
+	for (uint8_t j = 0; j < bh; j++)
+	{
+		if (y + j < 0 || y + j >= h)
+			continue;
+		for (uint8_t i = 0; i < bw; i++)
+		{
+			if (x + i < 0 || x + i >= w)
+				continue;
+			const RGB *s = bmp + (uint16_t)j * bw + i;
+			RGB *d = cnv + index(x + i, y + j);
+			if (pgm)
+				*d = CLR(pgm_read_byte(&s->r), pgm_read_byte(&s->g), pgm_read_byte(&s->b));
+			else
+				*d = *s;
+		}
+	}
+	dirty = true;
+}
+
+/**
+**  This function draws s in the 5x7 font with its top left at x, y.  Only the lit
+**  pixels are drawn.  Scroll text by drawing it at a smaller x each frame.
+**/
+int16_t
+matrixPat::text(const char *s, int16_t x, int16_t y, RGB c)
+{
+	for (; *s; s++, x += MX_FONTW + 1)
+	{
+		if (x >= w)
+		{
+			x += strlen(s) * (MX_FONTW + 1);		// rest is off the right edge
+			break;
+		}
+		if (x + MX_FONTW <= 0 || *s < 0x20 || *s > 0x7e)
+			continue;
+		const uint8_t *g = font5x7 + (*s - 0x20) * MX_FONTW;
+		for (uint8_t i = 0; i < MX_FONTW; i++)
+		{
+			uint8_t bits = pgm_read_byte(g + i);
+			for (uint8_t j = 0; bits; j++, bits >>= 1)
+				if (bits & 1)
+					setPix(x + i, y + j, c);
+		}
+	}
+	return x;
+}
+
+bool
+matrixPat::advance(uint16_t deltaT)
+{
+	bool d = dirty;
+
+	dirty = false;
+	return d;
+}
+
+uint8_t *
+matrixPat::fillRGB(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	return FILL_FMT(f.fmt, fillT, p, f, from, n);
+}
+
+void
+matrixPat::memUsage(LTBMem &m)
+{
+	m.patterns += sizeof(*this);
+	m.buffers += (size_t)numReps * (sizeof(RGB) + sizeof(uint16_t));
+	Pattern::memUsage(m);
+}
@@ -0,0 +1,89 @@
+// LTBMatrix.h
+
+#ifndef _LTBMATRIX_h
+#define _LTBMATRIX_h
+
+#include "LTBDots.h"
+
+#define MX_SERPENTINE	0x01		// every other line of the wiring runs backwards
+#define MX_COLUMNS		0x02		// wired up and down columns rather than along rows
+#define MX_FLIPX		0x04		// first pixel is on the right of the panel
+#define MX_FLIPY		0x08		// first pixel is at the bottom of the panel
+#define MX_ROT0			0x00		// logical picture rotation, clockwise
+#define MX_ROT90		0x10
+#define MX_ROT180		0x20
+#define MX_ROT270		0x30
+#define MX_ROTMASK		0x30
+
+#define MX_FONTW		5			// glyph columns, text advances MX_FONTW + 1 per character
+#define MX_FONTH		8			// glyph rows, 7 plus descenders
+
+/*!
+* \class matrixPat
+*
+* \brief a strip folded into a panel, drawn in logical x, y
+*
+* The panel is pw x ph pixels as wired, starting at the pattern's place in the chain.
+* Drawing goes into a logical canvas (rotated panels swap width and height) and fillRGB
+* gathers it into the frame through an index table built once from the wiring flags,
+* so the frame is written in order and only the table knows about serpentines or
+* rotation.  Drawing marks the pattern changed and the next showLights sends it.
+* Costs 5 bytes per pixel (canvas and table); see memUsage.
+*
+* \author Kevin Wilson
+* \date
+*/
+class matrixPat :public Pattern
+{
+public:
+	matrixPat(uint8_t pw, uint8_t ph, uint8_t flags = 0, uint8_t onlvl = 100);
+	~matrixPat();
+
+	inline uint8_t	width() { return w; };
+	inline uint8_t	height() { return h; };
+	inline RGB		*canvas() { return cnv; };			// row major, w * h, call touch() after writing
+	inline void		touch() { dirty = true; };
+	inline uint16_t	index(uint8_t x, uint8_t y) { return (uint16_t)y * w + x; };
+
+	void			setPix(int16_t x, int16_t y, RGB c);
+	RGB				getPix(int16_t x, int16_t y);
+	void			fill(RGB c);
+	void			line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, RGB c);
+	void			blit(const RGB *bmp, uint8_t bw, uint8_t bh, int16_t x, int16_t y, bool pgm = false);
+	int16_t			text(const char *s, int16_t x, int16_t y, RGB c);	// returns x after the text
+	static inline int16_t	textWidth(const char *s) { return strlen(s) * (MX_FONTW + 1); };
+
+	uint8_t			*fillRGB(uint8_t *p, LTBFill &f, uint16_t from = 0, uint16_t n = FILL_ALL);
+	bool			advance(uint16_t deltaT);
+	void			memUsage(LTBMem &m);
+
+protected:
+	template <class... P> friend class StaticChain;
+	template <class F> uint8_t	*fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n);
+	template <class F> inline uint8_t	*fillDitherT(uint8_t *p, uint8_t *err, LTBFill &f, uint16_t from, uint16_t n)
+	{ return fillT<F>(p, f, from, n); };
+	void			reCalc() {};
+	void			buildMap(uint8_t pw, uint8_t ph, uint8_t flags);
+	matrixPat(const matrixPat &p);
+
+	RGB				*cnv;			// logical picture
+	uint16_t		*map;			// canvas index of each wired pixel
+	uint8_t			w;				// logical width
+	uint8_t			h;				// logical height
+	bool			dirty;			// drawn since the last fill
+};
+
+template <class F> uint8_t *
+matrixPat::fillT(uint8_t *p, LTBFill &f, uint16_t from, uint16_t n)
+{
+	n = fillSpan(numReps, from, n);
+	for (uint16_t i = from; i < from + n; i++)
+	{
+		RGB c = lvlRGB(cnv[map[i]], onLvl);
+		f.chanSum += c.r + c.g + c.b;
+		p = F::put(p, c);
+	}
+	return p;
+}
+
+#endif
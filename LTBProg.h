@@ -0,0 +1,42 @@
+// LTBProg.h
+//
+// Bytecode for effect programs run by LTBVM and written by the host assembler in
+// extras/ltbasm.  Plain constants only, like LTBScene.h, so host tools can include it.
+// 16 bit operands are little endian.
+//
+//	header		'L' 'T' 'B' 'P' version 0 0 0
+//	code		instructions, the last one VM_END
+//
+// The VM works on one target pattern at a time (VM_PAT), with a color register, an
+// 8 bit register a, and a small stack of loop counters.
+
+#ifndef _LTBPROG_h
+#define _LTBPROG_h
+
+#define LTBP_MAGIC		"LTBP"
+#define LTBP_VERSION	1
+#define LTBP_HDRLEN		8
+
+//		opcode			  operands			effect
+#define VM_END		0x00	//					stop the program
+#define VM_PAT		0x01	// i				target the i'th pattern of the strip
+#define VM_RGB		0x02	// r g b			set the color
+#define VM_HUE		0x03	// h				color = hsvRGB(h, 255, 255)
+#define VM_FILL		0x04	// s e				fill target pixels s..e with the color, e 255 = last
+#define VM_ROTL		0x05	// n				rotate the target n pixels left
+#define VM_ROTR		0x06	// n				rotate the target n pixels right
+#define VM_DIM		0x07	// pct msLo msHi	dimPat(pct, ms) on the target
+#define VM_WAIT		0x08	// msLo msHi		pause the program
+#define VM_LOOP		0x09	// n				run up to the matching VM_NEXT n times, 0 forever
+#define VM_NEXT		0x0a	//
+#define VM_RAND		0x0b	// n				a = random(n), n 0 = 256
+#define VM_SETA		0x0c	// n				a = n
+#define VM_ADDA		0x0d	// n				a += n, wrapping
+#define VM_PIXA		0x0e	//					fill target pixel a with the color
+#define VM_HUEA		0x0f	//					color = hsvRGB(a, 255, 255)
+#define VM_NOPS		0x10
+
+#define VM_OPLEN	{ 1, 2, 4, 2, 3, 2, 2, 4, 3, 2, 1, 2, 2, 2, 1, 1 }	// bytes, opcode included
+#define VM_STACK	4			// loop nesting depth
+
+#endif
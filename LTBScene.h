@@ -0,0 +1,30 @@
+// LTBScene.h
+//
+// Binary scene format read by LTBDots::loadScene and written by the host compiler in
+// extras/ltbscene.  Only plain constants live here so host tools can include it without
+// the Arduino headers.  All multi-byte fields are little endian.
+//
+//	header		'L' 'T' 'B' 'S' version nPal nPat 0
+//	palette		nClr, nClr * (r g b)							repeated nPal times
+//	pattern		type pal palOff numPix repsLo repsHi onLvl nAct	repeated nPat times
+//	action		type tgt durLo durHi							nAct follow each pattern
+//
+// Palettes are copied once into the arena and shared by every pattern that refers to
+// them, the same way patterns built with addPat share the caller's RGB array.
+
+#ifndef _LTBSCENE_h
+#define _LTBSCENE_h
+
+#define LTBS_MAGIC		"LTBS"
+#define LTBS_VERSION	1
+#define LTBS_HDRLEN		8
+#define LTBS_PATLEN		8
+#define LTBS_ACTLEN		4
+
+#define LTBS_PIXPAT		1			// pixPat, numPix colors from the palette
+#define LTBS_RTPAT		2			// RTPat, ramp between 2 colors from the palette
+
+#define LTBS_ACT_DIM	1			// dimPat(tgt, dur)
+#define LTBS_MAXDUR		32767		// longest dim, msec; the action keeps its time in a short
+
+#endif
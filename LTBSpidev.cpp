@@ -0,0 +1,191 @@
+/*!
+* \file LTBSpidev.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* Linux spidev output backend for LTBDots
+*/
+
+#if defined(__linux__)
+
+#include "LTBSpidev.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+static const uint8_t zeroBlk[SPIDEV_ZEROBUF] = { 0 };
+
+
+SpidevOut::SpidevOut(const char *dev, uint32_t hz, uint8_t mode)
+{
+	path = dev;
+	fd = -1;
+	plainFile = false;
+	speed = hz;
+	spiMode = mode;
+	bufsiz = 4096;
+	msgBytes = 0;
+	nXfer = 0;
+	errors = 0;
+	lastErr = 0;
+}
+
+SpidevOut::~SpidevOut()
+{
+	end();
+}
+
+bool
+SpidevOut::begin()
+{
+	uint8_t bits = 8;
+
+	end();
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		fd = open(path, O_WRONLY);			// fifos and test files may be write only
+	if (fd < 0)
+		return false;
+
+	if (ioctl(fd, SPI_IOC_WR_MODE, &spiMode) < 0)
+	{
+		if (errno != ENOTTY)
+		{
+			end();
+			return false;
+		}
+		plainFile = true;					// not a spidev node, fall back to write()
+		bufsiz = (size_t)-1;
+		return true;
+	}
+	plainFile = false;
+	if (ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+		ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
+	{
+		end();
+		return false;
+	}
+
+	// the kernel refuses messages larger than the spidev bufsiz parameter
+	FILE *f = fopen("/sys/module/spidev/parameters/bufsiz", "r");
+	unsigned long sz;
+	bufsiz = 4096;
+	if (f)
+	{
+		if (fscanf(f, "%lu", &sz) == 1 && sz > 0)
+			bufsiz = sz;
+		fclose(f);
+	}
+	return true;
+}
+
+void
+SpidevOut::end()
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+	nXfer = 0;
+	msgBytes = 0;
+}
+
+void
+SpidevOut::write(const uint8_t *p, size_t n)
+{
+	queue(p, n);
+}
+
+void
+SpidevOut::zeros(size_t n)
+{
+	while (n)
+	{
+		size_t len = n < SPIDEV_ZEROBUF ? n : SPIDEV_ZEROBUF;
+		queue(zeroBlk, len);
+		n -= len;
+	}
+}
+
+void
+SpidevOut::endFrame()
+{
+	flush();
+}
+
+/************************************************************************/
+/* This function adds n bytes to the message, splitting them into       */
+/* transfers so that no message exceeds the spidev bufsiz               */
+/************************************************************************/
+void
+SpidevOut::queue(const uint8_t *p, size_t n)
+{
+	if (fd < 0)
+		return;
+
+	while (n)
+	{
+		if (nXfer == SPIDEV_MAXXFER || msgBytes == bufsiz)
+			flush();
+
+		size_t len = bufsiz - msgBytes;
+		if (len > n)
+			len = n;
+
+		struct spi_ioc_transfer *x = &xfer[nXfer++];
+		memset(x, 0, sizeof(*x));
+		x->tx_buf = (unsigned long)p;
+		x->len = len;
+		x->speed_hz = speed;
+		x->bits_per_word = 8;
+
+		msgBytes += len;
+		p += len;
+		n -= len;
+	}
+}
+
+/************************************************************************/
+/* This function sends all queued transfers as one SPI_IOC_MESSAGE      */
+/************************************************************************/
+void
+SpidevOut::flush()
+{
+	if (nXfer == 0 || fd < 0)
+		return;
+
+	if (plainFile)
+	{
+		for (uint16_t i = 0; i < nXfer; i++)
+		{
+			const uint8_t *p = (const uint8_t *)(unsigned long)xfer[i].tx_buf;
+			size_t n = xfer[i].len;
+			while (n)
+			{
+				ssize_t w = ::write(fd, p, n);
+				if (w < 0 && errno == EINTR)
+					continue;
+				if (w <= 0)
+				{
+					errors++;
+					lastErr = w < 0 ? errno : EIO;
+					break;
+				}
+				p += w;
+				n -= w;
+			}
+		}
+	}
+	else if (ioctl(fd, _IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0, SPI_MSGSIZE(nXfer)), xfer) < 0)
+	{
+		errors++;
+		lastErr = errno;
+	}
+
+	nXfer = 0;
+	msgBytes = 0;
+}
+
+#endif
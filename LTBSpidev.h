@@ -0,0 +1,69 @@
+// LTBSpidev.h
+
+#ifndef _LTBSPIDEV_h
+#define _LTBSPIDEV_h
+
+#if defined(__linux__)
+
+#include "LTBDots.h"
+#include <linux/spi/spidev.h>
+
+#define SPIDEV_MAXXFER	511			// transfers per SPI_IOC_MESSAGE, limited by the ioctl size field
+#define SPIDEV_ZEROBUF	512			// size of the shared block of zeros used for leader/trailer
+
+/*!
+* \class SpidevOut
+*
+* \brief DotsOut backend for Linux hosts writing through /dev/spidevX.Y
+*
+* Each frame is queued as a list of spi_ioc_transfer chunks and sent with a single
+* SPI_IOC_MESSAGE ioctl.  The kernel caps the total bytes of one message at the spidev
+* bufsiz module parameter (4096 by default), so frames larger than that are split across
+* as few messages as possible; load spidev with a larger bufsiz to get one ioctl per frame.
+*
+* If the path opened is not a spidev node (a plain file, fifo or other character device)
+* the SPI ioctls fail and the queued bytes are written with write() instead, so a file can
+* stand in for the hardware when testing.  A message the kernel refuses, or a short write,
+* is counted in getErrors with its errno kept for getErrno.
+*
+* \author Kevin Wilson
+* \date
+*/
+class SpidevOut :public DotsOut
+{
+public:
+	SpidevOut(const char *dev, uint32_t hz = 8000000, uint8_t mode = SPI_MODE_0);
+	~SpidevOut();
+
+	bool			begin();								// open the device, false on failure
+	void			end();									// close the device
+	inline bool		isOpen() { return fd >= 0; };
+	inline bool		isSpidev() { return fd >= 0 && !plainFile; };
+	inline uint32_t	getErrors() { return errors; };			// failed messages or writes
+	inline int		getErrno() { return lastErr; };			// errno of the last failure, 0 for none
+	inline void		clearErrors() { errors = 0; lastErr = 0; };
+
+	void			write(const uint8_t *p, size_t n);
+	void			zeros(size_t n);
+	void			endFrame();
+
+protected:
+	void			queue(const uint8_t *p, size_t n);
+	void			flush();
+
+	const char		*path;
+	int				fd;				// persistent file descriptor, -1 when closed
+	bool			plainFile;		// true if fd is not a spidev node
+	uint32_t		speed;			// SPI clock in Hz
+	uint8_t			spiMode;
+	size_t			bufsiz;			// max bytes per message, from the spidev module
+	size_t			msgBytes;		// bytes queued in the current message
+	uint16_t		nXfer;			// transfers queued in the current message
+	uint32_t		errors;
+	int				lastErr;
+	struct spi_ioc_transfer xfer[SPIDEV_MAXXFER];
+};
+
+#endif
+
+#endif
@@ -0,0 +1,480 @@
+/*!
+* \file LTBSync.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* Shared timebase and epoch across controllers
+*/
+
+#include "LTBSync.h"
+
+static void
+putTime(uint8_t *p, const SyncTime &t)
+{
+	p[0] = t.ms;
+	p[1] = t.ms >> 8;
+	p[2] = t.ms >> 16;
+	p[3] = t.ms >> 24;
+	p[4] = t.us;
+	p[5] = t.us >> 8;
+}
+
+static void
+getTime(const uint8_t *p, SyncTime &t)
+{
+	t.ms = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	t.us = p[4] | (p[5] << 8);
+}
+
+/**  a - b in msec and usec, the usec part -999 to 999 **/
+static inline void
+diffTime(const SyncTime &a, const SyncTime &b, int32_t &ms, int32_t &us)
+{
+	ms = (int32_t)(a.ms - b.ms);
+	us = (int32_t)a.us - b.us;
+}
+
+/**  brings us into 0-999, carrying into ms **/
+static void
+normTime(int32_t &ms, int32_t &us)
+{
+	ms += us / 1000;
+	us %= 1000;
+	if (us < 0)
+	{
+		us += 1000;
+		ms--;
+	}
+}
+
+
+void
+LoopLink::send(const uint8_t *p, uint8_t n)
+{
+	if (peer == NULL || n > SYNC_MSGMAX || peer->count == SYNC_LOOPQ)
+		return;
+
+	uint8_t i = (peer->head + peer->count++) % SYNC_LOOPQ;
+	memcpy(peer->msg[i], p, n);
+	peer->len[i] = n;
+}
+
+uint8_t
+LoopLink::recv(uint8_t *p, uint8_t max)
+{
+	while (count)
+	{
+		uint8_t n = len[head];
+		const uint8_t *m = msg[head];
+		head = (head + 1) % SYNC_LOOPQ;
+		count--;
+		if (n <= max)
+		{
+			memcpy(p, m, n);
+			return n;
+		}
+	}
+	return 0;
+}
+
+#if defined(ARDUINO)
+void
+StreamLink::send(const uint8_t *p, uint8_t n)
+{
+	uint8_t sum = 0;
+
+	for (uint8_t i = 0; i < n; i++)
+		sum += p[i];
+	port.write((uint8_t)SYNC_FRAME);
+	port.write(n);
+	port.write(p, n);
+	port.write(sum);
+}
+
+uint8_t
+StreamLink::recv(uint8_t *p, uint8_t max)
+{
+	while (port.available() > 0)
+	{
+		int c = port.read();
+
+		if (c < 0)
+			break;
+		if (got == 0)
+		{
+			if (c == SYNC_FRAME)
+				buf[got++] = c;
+			continue;
+		}
+		if (got == 1)
+		{
+			if (c == 0 || c > SYNC_MSGMAX)
+			{
+				got = 0;
+				continue;
+			}
+			want = c + 3;
+		}
+		buf[got++] = c;
+		if (got < want)
+			continue;
+
+		/**  whole message, check the sum **/
+		uint8_t n = buf[1], sum = 0;
+		got = 0;
+		for (uint8_t i = 0; i < n; i++)
+			sum += buf[2 + i];
+		if (sum != buf[2 + n] || n > max)
+			continue;
+		memcpy(p, buf + 2, n);
+		return n;
+	}
+	return 0;
+}
+#endif
+
+
+LTBSync::LTBSync(SyncLink *l, bool master, SyncMicros us)
+{
+	link = l;
+	usec = us;
+	this->master = master;
+	lastUs = usec();
+	loc.ms = 0;
+	loc.us = 0;
+	restart();
+	boot = master ? (uint16_t)(random(0x10000) ^ lastUs) : 0;
+	pollMs = SYNC_POLLMS;
+	lastReq = 0;
+	seq = 0;
+	t0 = loc;
+	epoch = 0;
+	epochAt = 0;
+	nextEpoch = 0;
+	nextAt = 0;
+	pending = false;
+	frame = 0;
+	frameAt = 0;
+	framed = false;
+}
+
+/**  forgets the offset and skew, for a new master **/
+void
+LTBSync::restart()
+{
+	valid = false;
+	offMs = 0;
+	offUs = 0;
+	skew = 0;
+	baseMs = 0;
+	last = loc;
+	jumped = true;
+	bestRtt = 0;
+	framed = false;
+}
+
+/**
+**  This function reads the local clock, counting from construction.  Called at least
+**  every 71 minutes (the micros() wrap) it never loses time.
+**/
+void
+LTBSync::local(SyncTime &t)
+{
+	uint32_t us = usec();
+	uint32_t d = us - lastUs;
+
+	lastUs = us;
+	loc.ms += d / 1000;
+	loc.us += d % 1000;
+	if (loc.us >= 1000)
+	{
+		loc.us -= 1000;
+		loc.ms++;
+	}
+	t = loc;
+}
+
+void
+LTBSync::sharedTime(SyncTime &t)
+{
+	int32_t c = 0, us;
+
+	local(t);
+	us = (int32_t)t.us + offUs + drift(t.ms);
+	normTime(c, us);
+	t.ms += offMs + c;
+	t.us = us;
+
+	/**  never back, hold until real time catches up with a correction, unless stepped **/
+	if (!jumped && ((int32_t)(t.ms - last.ms) < 0 || (t.ms == last.ms && t.us < last.us)))
+		t = last;
+	else
+		last = t;
+	jumped = false;
+}
+
+/**  usec the measured skew has added since the offset was last set **/
+int32_t
+LTBSync::drift(uint32_t locMs)
+{
+	uint32_t el = locMs - baseMs;
+
+	if (el > SYNC_MAXDRIFT)
+		el = SYNC_MAXDRIFT;
+	return (int32_t)el * skew / 8000;
+}
+
+uint32_t
+LTBSync::now()
+{
+	SyncTime t;
+
+	sharedTime(t);
+	return t.ms;
+}
+
+int32_t
+LTBSync::getOffset()
+{
+	if (offMs > 2147482)
+		return 0x7fffffff;
+	if (offMs < -2147482)
+		return -0x7fffffff;
+	return offMs * 1000 + offUs;
+}
+
+/**
+**  This function handles whatever has come in over the link and, on a slave, sends the
+**  next request when it is due.  Until the first good reply requests go 8 times as often.
+**/
+void
+LTBSync::poll()
+{
+	uint8_t m[SYNC_MSGMAX], n;
+	SyncTime t;
+
+	while ((n = link->recv(m, sizeof(m))) != 0)
+	{
+		local(t);							// stamp it before anything else
+		if (master && n == SYNC_REQLEN && m[0] == SYNC_REQ)
+			reply(m, t);
+		else if (!master && n == SYNC_RESPLEN && m[0] == SYNC_RESP)
+			answer(m, t);
+	}
+
+	if (!master)
+	{
+		local(t);
+		if (t.ms - lastReq >= (valid ? pollMs : pollMs / 8))
+			request();
+	}
+}
+
+void
+LTBSync::request()
+{
+	uint8_t m[SYNC_REQLEN];
+
+	m[0] = SYNC_REQ;
+	m[1] = ++seq;
+	local(t0);
+	lastReq = t0.ms;
+	putTime(m + 2, t0);
+	link->send(m, SYNC_REQLEN);
+}
+
+/**
+**  This function answers a slave's request.  t1 is when it arrived; t2 is stamped as late
+**  as possible, so the time spent here is taken out of the round trip.  A master that
+**  has set an epoch not yet started passes that one on, so slaves know ahead.
+**/
+void
+LTBSync::reply(const uint8_t *req, SyncTime &t1)
+{
+	uint8_t m[SYNC_RESPLEN];
+	SyncTime t2;
+
+	getEpoch();
+	m[0] = SYNC_RESP;
+	m[1] = req[1];
+	memcpy(m + 2, req + 2, 6);				// t0 back, so each slave on a bus knows its own
+	putTime(m + 8, t1);
+	m[20] = pending ? nextEpoch : epoch;
+	m[21] = (pending ? nextEpoch : epoch) >> 8;
+	uint32_t at = pending ? nextAt : epochAt;
+	m[22] = at;
+	m[23] = at >> 8;
+	m[24] = at >> 16;
+	m[25] = at >> 24;
+	m[26] = boot;
+	m[27] = boot >> 8;
+	local(t2);
+	putTime(m + 14, t2);
+	link->send(m, SYNC_RESPLEN);
+}
+
+/**
+**  This function takes a reply to the outstanding request, stamped t3 on arrival.
+**      offset = ((t1 - t0) + (t2 - t3)) / 2
+**      round trip = (t3 - t0) - (t2 - t1)
+**  Offsets run to hours, so they are kept as msec and usec.
+**/
+void
+LTBSync::answer(const uint8_t *m, SyncTime &t3)
+{
+	SyncTime e0, t1, t2;
+	int32_t ams, aus, bms, bus;
+
+	getTime(m + 2, e0);
+	if (m[1] != seq || e0.ms != t0.ms || e0.us != t0.us)
+		return;								// someone else's, or one we gave up on
+	getTime(m + 8, t1);
+	getTime(m + 14, t2);
+
+	uint16_t b = m[26] | (m[27] << 8);
+	if (valid && b != boot)
+		restart();							// the master restarted, or another took over
+	boot = b;
+
+	/**  round trip, all local or all remote so the msec parts are small **/
+	diffTime(t3, t0, ams, aus);
+	diffTime(t2, t1, bms, bus);
+	if (ams > 2000 || bms > 2000 || bms < 0)
+		return;
+	int32_t rtt = (ams - bms) * 1000 + aus - bus;
+	if (rtt < 0)
+		rtt = 0;
+
+	/**  trust only round trips near the best, and let the best creep up if the link slows **/
+	if (valid && rtt > bestRtt + SYNC_JITTER)
+	{
+		bestRtt += (rtt - bestRtt) / 8;
+		return;
+	}
+	if (!valid || rtt < bestRtt)
+		bestRtt = rtt;
+
+	diffTime(t1, t0, ams, aus);
+	diffTime(t2, t3, bms, bus);
+	ams += bms;
+	aus += bus;
+	if (ams & 1)							// halve msec and usec together
+	{
+		ams--;
+		aus += 1000;
+	}
+	ams /= 2;
+	aus /= 2;
+	normTime(ams, aus);
+	adjust(ams, aus, t3.ms);
+
+	schedule(m[20] | (m[21] << 8),
+		(uint32_t)m[22] | ((uint32_t)m[23] << 8) | ((uint32_t)m[24] << 16) | ((uint32_t)m[25] << 24));
+}
+
+/**
+**  This function takes a new offset measured at local msec locMs.  Against the offset
+**  the skew predicts for then, a small error is taken halfway and a quarter of its rate
+**  goes into the skew, so crystals that run at different rates stay together between
+**  polls; big ones (the first, or after a lost master) are stepped, and shared time
+**  jumps to the new offset even if that is back, restarting frameDue's count.
+**/
+void
+LTBSync::adjust(int32_t ms, int32_t us, uint32_t locMs)
+{
+	int32_t pms = offMs, pus = (int32_t)offUs + drift(locMs);
+	bool step = true;
+
+	normTime(pms, pus);
+	int32_t dms = ms - pms;
+	if (valid && dms > -SYNC_STEPUS / 1000 - 2 && dms < SYNC_STEPUS / 1000 + 2)
+	{
+		int32_t e = dms * 1000 + us - pus;
+		if (e > -SYNC_STEPUS && e < SYNC_STEPUS)
+		{
+			uint32_t el = locMs - baseMs;
+			if (el >= 1000 && el <= SYNC_MAXDRIFT)
+			{
+				skew += e * 2000 / (int32_t)el;
+				if (skew > SYNC_MAXSKEW * 8)
+					skew = SYNC_MAXSKEW * 8;
+				if (skew < -SYNC_MAXSKEW * 8)
+					skew = -SYNC_MAXSKEW * 8;
+			}
+			ms = pms;
+			us = pus + e / 2;
+			normTime(ms, us);
+			step = false;
+		}
+	}
+	if (step)
+	{
+		jumped = true;
+		framed = false;
+	}
+	offMs = ms;
+	offUs = us;
+	baseMs = locMs;
+	valid = true;
+}
+
+void
+LTBSync::schedule(uint16_t e, uint32_t atMs)
+{
+	if (e == epoch && atMs == epochAt)
+		pending = false;
+	else if (!pending || e != nextEpoch || atMs != nextAt)
+	{
+		nextEpoch = e;
+		nextAt = atMs;
+		pending = true;
+	}
+}
+
+/**
+**  This function starts epoch e at shared msec atMs, now or in the past if that's
+**  wanted; slaves hear of it at their next poll, so give them a couple of poll intervals.
+**/
+void
+LTBSync::setEpoch(uint16_t e, uint32_t atMs)
+{
+	if (master)
+		schedule(e, atMs);
+}
+
+uint16_t
+LTBSync::getEpoch()
+{
+	if (pending && (int32_t)(now() - nextAt) >= 0)
+	{
+		epoch = nextEpoch;
+		epochAt = nextAt;
+		pending = false;
+	}
+	return epoch;
+}
+
+/**
+**  This function returns true once for each periodMs frame of shared time counted from
+**  the epoch start, at the first call after it begins.  The first call only finds its
+**  place, so a node joining mid-frame waits for the next edge.
+**/
+bool
+LTBSync::frameDue(uint16_t periodMs)
+{
+	if (periodMs == 0 || !synced())
+		return false;
+	getEpoch();
+
+	int32_t since = (int32_t)(now() - epochAt);
+	if (since < 0)
+		return false;
+
+	uint32_t k = (uint32_t)since / periodMs;
+	bool due = framed && (k != frame || frameAt != epochAt);
+	frame = k;
+	frameAt = epochAt;
+	framed = true;
+	return due;
+}
@@ -0,0 +1,201 @@
+// LTBSync.h
+
+#ifndef _LTBSYNC_h
+#define _LTBSYNC_h
+
+#include "LTBDots.h"
+
+#define SYNC_MSGMAX		32			// longest message a link has to carry
+#define SYNC_LOOPQ		4			// messages a LoopLink holds before dropping
+#define SYNC_POLLMS		1000		// default msec between a slave's requests
+#define SYNC_JITTER		200			// usec of round trip above the best seen that is still trusted
+#define SYNC_STEPUS		2000		// corrections bigger than this are stepped, smaller are halved
+#define SYNC_MAXSKEW	1000		// ppm of crystal error corrected for
+#define SYNC_MAXDRIFT	240000		// msec the skew is followed without a good reply
+
+#define SYNC_REQ		1			// slave -> master: seq, t0
+#define SYNC_RESP		2			// master -> slaves: seq, t0, t1, t2, epoch, epoch start, boot id
+#define SYNC_REQLEN		8
+#define SYNC_RESPLEN	28
+
+#define SYNC_FRAME		0xa5		// StreamLink start of message
+
+typedef unsigned long (*SyncMicros)();
+
+typedef struct SyncTime
+{
+	uint32_t	ms;
+	uint16_t	us;				// 0-999
+} SyncTime;
+
+/*!
+* \class SyncLink
+*
+* \brief message transport for LTBSync
+*
+* send hands over one whole message; recv returns the length of the next whole message,
+* or 0 if none has arrived, and never waits.  Messages may be lost but must not be cut
+* short or merged.  Anything that can do that (serial, UDP, radio) will carry sync.
+*
+* \author Kevin Wilson
+* \date
+*/
+class SyncLink
+{
+public:
+	virtual ~SyncLink() {};
+
+	virtual void		send(const uint8_t *p, uint8_t n) = 0;
+	virtual uint8_t		recv(uint8_t *p, uint8_t max) = 0;
+};
+
+/*!
+* \class LoopLink
+*
+* \brief in-memory SyncLink, for running several nodes in one host program
+*
+* connect two links and what one sends the other receives.  Each link queues up to
+* SYNC_LOOPQ messages and drops after that, much as a busy serial port would.
+*
+* \author Kevin Wilson
+* \date
+*/
+class LoopLink :public SyncLink
+{
+public:
+	LoopLink() { peer = NULL; head = 0; count = 0; };
+
+	static void			connect(LoopLink &a, LoopLink &b) { a.peer = &b; b.peer = &a; };
+
+	void				send(const uint8_t *p, uint8_t n);
+	uint8_t				recv(uint8_t *p, uint8_t max);
+
+protected:
+	LoopLink			*peer;
+	uint8_t				msg[SYNC_LOOPQ][SYNC_MSGMAX];
+	uint8_t				len[SYNC_LOOPQ];
+	uint8_t				head;			// oldest queued
+	uint8_t				count;
+};
+
+#if defined(ARDUINO)
+/*!
+* \class StreamLink
+*
+* \brief SyncLink over a serial port or any other Arduino Stream
+*
+* Frames each message as SYNC_FRAME, length, bytes, 8 bit sum, and resynchronises on the
+* next SYNC_FRAME after noise.  A message is stamped when recv finds it complete, so call
+* LTBSync::poll often; the serial time itself cancels out as long as both ways run at the
+* same baud rate.
+*
+* \author Kevin Wilson
+* \date
+*/
+class StreamLink :public SyncLink
+{
+public:
+	StreamLink(Stream &s) : port(s) { got = 0; want = 0; };
+
+	void				send(const uint8_t *p, uint8_t n);
+	uint8_t				recv(uint8_t *p, uint8_t max);
+
+protected:
+	Stream				&port;
+	uint8_t				buf[SYNC_MSGMAX + 3];
+	uint8_t				got;			// bytes of the current message so far
+	uint8_t				want;			// its full framed length, 0 until the length byte
+};
+#endif
+
+/*!
+* \class LTBSync
+*
+* \brief shared timebase and scene epoch for several controllers
+*
+* One node is the master; its own micros() is the shared time.  Each slave asks the master
+* for the time every SYNC_POLLMS and works out its offset the NTP way, from the four
+* stamps of a request and its reply, so the link delay cancels as long as it is the same
+* both ways.  Only replies with a round trip close to the best seen are used, which
+* throws out the ones held up in a queue.  Crystal drift of 100 ppm is 0.1 msec a
+* second, so polling once a second holds the nodes well inside 1 msec.
+*
+* LTBSync is a DotsClock: once synced(), setClock(&sync) on the strip and effect time
+* runs at the same rate everywhere.  Shared time never goes backwards for the small
+* corrections of normal running; those hold the clock until real time catches up.  A
+* stepped correction jumps, back if need be, so a slave follows a master that has
+* restarted.  Each master also sends a boot id, random unless setBootId gives one (say a
+* count kept in EEPROM), and a slave that sees it change starts over as if just
+* constructed, dropping the old master's skew.
+*
+* The master can also set an epoch, a number and the shared msec it starts at, which is
+* passed on in every reply.  Load the scene for the epoch when getEpoch changes and all
+* nodes start it together.  frameDue splits shared time into frames counted from the
+* epoch start: render with renderFrame beforehand and call sendFrame when it comes
+* true, and every node latches the same frame at the same moment.
+*
+* \author Kevin Wilson
+* \date
+*/
+class LTBSync :public DotsClock
+{
+public:
+	LTBSync(SyncLink *l, bool master, SyncMicros us = micros);
+
+	void			poll();									// call every loop
+	uint32_t		now();									// shared msec
+	void			sharedTime(SyncTime &t);
+	inline bool		synced() { return master || valid; };
+	inline bool		isMaster() { return master; };
+	inline void		setPollInterval(uint16_t ms) { pollMs = ms; };
+	inline void		setBootId(uint16_t id) { boot = id; };	// master: changes every restart
+	int32_t			getOffset();							// usec added to local time, clamped
+	inline int32_t	getRtt() { return bestRtt; };			// best round trip, usec
+	inline int32_t	getSkew() { return skew / 8; };		// ppm the local crystal is corrected by
+
+	void			setEpoch(uint16_t e, uint32_t atMs);	// master only
+	uint16_t		getEpoch();
+	inline uint32_t	getEpochStart() { return epochAt; };
+
+	bool			frameDue(uint16_t periodMs);
+	inline uint32_t	getFrame() { return frame; };			// frames since the epoch start
+
+protected:
+	void			local(SyncTime &t);
+	void			request();
+	void			reply(const uint8_t *m, SyncTime &t1);
+	void			answer(const uint8_t *m, SyncTime &t3);
+	void			adjust(int32_t ms, int32_t us, uint32_t locMs);
+	void			restart();
+	int32_t			drift(uint32_t locMs);
+	void			schedule(uint16_t e, uint32_t atMs);
+
+	SyncLink		*link;
+	SyncMicros		usec;
+	bool			master;
+	bool			valid;			// slave has an offset
+	uint32_t		lastUs;			// micros at the last local()
+	SyncTime		loc;			// local time, from construction
+	int32_t			offMs;			// shared - local, msec part
+	uint16_t		offUs;			// and usec part, 0-999
+	uint32_t		baseMs;			// local msec the offset was set
+	int32_t			skew;			// local clock error, 1/8 ppm
+	SyncTime		last;			// latest shared time handed out
+	bool			jumped;			// the offset was stepped, last may be passed going back
+	uint16_t		boot;			// master: its boot id; slave: the id of the master followed
+	int32_t			bestRtt;
+	uint16_t		pollMs;
+	uint32_t		lastReq;		// local msec the last request went
+	uint8_t			seq;
+	SyncTime		t0;				// stamp of the outstanding request
+	uint16_t		epoch;
+	uint32_t		epochAt;		// shared msec the current epoch started
+	uint16_t		nextEpoch;
+	uint32_t		nextAt;
+	bool			pending;		// nextEpoch is set and hasn't started
+	uint32_t		frame;
+	uint32_t		frameAt;		// epoch start frame is counted from
+	bool			framed;			// frameDue has found its place
+};
+
+#endif
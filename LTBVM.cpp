@@ -0,0 +1,236 @@
+/*!
+* \file LTBVM.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* Bytecode interpreter for effect programs
+*/
+
+#include "LTBVM.h"
+
+static const uint8_t opLen[VM_NOPS] = VM_OPLEN;
+
+
+LTBVM::LTBVM(LTBDots *s, Pattern *host)
+{
+	strip = s;
+	pat = host;
+	code = NULL;
+	pgm = false;
+	clr = CLR(0, 0, 0);
+	a = 0;
+	durTime = 0;
+	durTmr = -1;							// never complete, reload to run again
+	restart();
+}
+
+/**
+**  This function checks prog and makes it the one to run, from the start.  Returns
+**  false, leaving the VM stopped, if anything about it is wrong.
+**/
+bool
+LTBVM::load(const uint8_t *prog, size_t len, bool pgm)
+{
+	uint8_t depth = 0, op = VM_END;
+	size_t i;
+
+	code = NULL;
+	if (len <= LTBP_HDRLEN || len - LTBP_HDRLEN > 0xffff)
+		return false;
+	for (i = 0; i < 4; i++)
+		if ((pgm ? pgm_read_byte(prog + i) : prog[i]) != (uint8_t)LTBP_MAGIC[i])
+			return false;
+	if ((pgm ? pgm_read_byte(prog + 4) : prog[4]) != LTBP_VERSION)
+		return false;
+
+	for (i = LTBP_HDRLEN; i < len; i += opLen[op])
+	{
+		op = pgm ? pgm_read_byte(prog + i) : prog[i];
+		if (op >= VM_NOPS || i + opLen[op] > len)
+			return false;
+		if (op == VM_LOOP && ++depth > VM_STACK)
+			return false;
+		if (op == VM_NEXT && depth-- == 0)
+			return false;
+	}
+	if (op != VM_END || depth != 0)
+		return false;
+
+	code = prog + LTBP_HDRLEN;
+	this->pgm = pgm;
+	restart();
+	return true;
+}
+
+bool
+LTBVM::timerTic(unsigned short deltaT)
+{
+	if (code == NULL)
+		return false;
+	if (wait > 0)
+	{
+		wait -= deltaT;
+		if (wait > 0)
+			return false;
+	}
+	return exec();
+}
+
+void
+LTBVM::fill(uint8_t s, uint8_t e)
+{
+	uint8_t n = tgt->getNumPix();
+
+	if (s >= n)
+		return;
+	if (e >= n)
+		e = n - 1;
+	if (e >= s)
+		tgt->fillPat(clr, s, e);
+}
+
+/**
+**  This function runs instructions until VM_WAIT, VM_END or VM_MAXOPS of them.  load
+**  has checked the code, so operands are always there and loops always balance.
+**/
+#ifdef VM_GOTO
+#define VM_OP(x)	L_##x:
+#define VM_NEXTOP()	do { if (--budget == 0) return changed; op = fetch(pc); goto *disp[op]; } while (0)
+#else
+#define VM_OP(x)	case x:
+#define VM_NEXTOP()	continue
+#endif
+
+bool
+LTBVM::exec()
+{
+	bool changed = false;
+	uint8_t budget = VM_MAXOPS;
+	uint8_t op, n;
+	Pattern *p;
+
+#ifdef VM_GOTO
+	static const void *const disp[VM_NOPS] = {
+		&&L_VM_END, &&L_VM_PAT, &&L_VM_RGB, &&L_VM_HUE, &&L_VM_FILL, &&L_VM_ROTL, &&L_VM_ROTR, &&L_VM_DIM,
+		&&L_VM_WAIT, &&L_VM_LOOP, &&L_VM_NEXT, &&L_VM_RAND, &&L_VM_SETA, &&L_VM_ADDA, &&L_VM_PIXA, &&L_VM_HUEA
+	};
+	op = fetch(pc);
+	goto *disp[op];
+	{
+#else
+	for (;; budget--)
+	{
+		if (budget == 0)
+			return changed;
+		op = fetch(pc);
+		switch (op)
+		{
+#endif
+	VM_OP(VM_END)
+		return changed;							// pc stays on the VM_END
+
+	VM_OP(VM_PAT)
+		n = fetch(pc + 1);
+		for (p = strip->firstPat(); p && n; n--)
+			p = p->Nxt();
+		tgt = p;
+		pc += 2;
+		VM_NEXTOP();
+
+	VM_OP(VM_RGB)
+		clr = CLR(fetch(pc + 1), fetch(pc + 2), fetch(pc + 3));
+		pc += 4;
+		VM_NEXTOP();
+
+	VM_OP(VM_HUE)
+		clr = hsvRGB(fetch(pc + 1), 255, 255);
+		pc += 2;
+		VM_NEXTOP();
+
+	VM_OP(VM_FILL)
+		if (tgt)
+		{
+			fill(fetch(pc + 1), fetch(pc + 2));
+			changed = true;
+		}
+		pc += 3;
+		VM_NEXTOP();
+
+	VM_OP(VM_ROTL)
+	VM_OP(VM_ROTR)
+		if (tgt && tgt->getNumPix())
+		{
+			n = fetch(pc + 1) % tgt->getNumPix();
+			if (n && op == VM_ROTL)
+				tgt->rotateLeft(n);
+			else if (n)
+				tgt->rotateRight(n);
+			changed = true;
+		}
+		pc += 2;
+		VM_NEXTOP();
+
+	VM_OP(VM_DIM)
+		if (tgt)
+			tgt->dimPat(fetch(pc + 1), fetch(pc + 2) | (fetch(pc + 3) << 8));
+		pc += 4;
+		VM_NEXTOP();
+
+	VM_OP(VM_WAIT)
+		wait += fetch(pc + 1) | (fetch(pc + 2) << 8);
+		pc += 3;
+		return changed;
+
+	VM_OP(VM_LOOP)
+		pc += 2;
+		loopPc[sp] = pc;
+		loopCnt[sp++] = fetch(pc - 1);
+		VM_NEXTOP();
+
+	VM_OP(VM_NEXT)
+		if (loopCnt[sp - 1] == 0 || --loopCnt[sp - 1] != 0)
+			pc = loopPc[sp - 1];				// round again
+		else
+		{
+			sp--;
+			pc += 1;
+		}
+		VM_NEXTOP();
+
+	VM_OP(VM_RAND)
+		n = fetch(pc + 1);
+		a = random(n ? n : 256);
+		pc += 2;
+		VM_NEXTOP();
+
+	VM_OP(VM_SETA)
+		a = fetch(pc + 1);
+		pc += 2;
+		VM_NEXTOP();
+
+	VM_OP(VM_ADDA)
+		a += fetch(pc + 1);
+		pc += 2;
+		VM_NEXTOP();
+
+	VM_OP(VM_PIXA)
+		if (tgt)
+		{
+			fill(a, a);
+			changed = true;
+		}
+		pc += 1;
+		VM_NEXTOP();
+
+	VM_OP(VM_HUEA)
+		clr = hsvRGB(a, 255, 255);
+		pc += 1;
+		VM_NEXTOP();
+
+#ifndef VM_GOTO
+		}
+#endif
+	}
+	return changed;
+}
@@ -0,0 +1,63 @@
+// LTBVM.h
+
+#ifndef _LTBVM_h
+#define _LTBVM_h
+
+#include "LTBDots.h"
+#include "LTBProg.h"
+
+#ifndef VM_MAXOPS
+#define VM_MAXOPS	255			// instructions per frame before the program is made to yield
+#endif
+
+#if defined(__GNUC__) && !defined(VM_NOGOTO)
+#define VM_GOTO		1			// threaded dispatch with computed goto
+#endif
+
+/*!
+* \class LTBVM
+*
+* \brief runs a bytecode effect program (LTBProg.h) on the strip's patterns
+*
+* Lets a deployed controller take new effects over the wire or from a file: load checks
+* the whole program once (opcodes, operand lengths, loop nesting, final VM_END) so the
+* interpreter itself does no bounds checks on the code.  It is an Action, so add it to
+* any pattern of the strip; it runs a slice each frame until a VM_WAIT or VM_END, and
+* the target starts as that pattern.  The program buffer must stay valid while loaded.
+*
+* \author Kevin Wilson
+* \date
+*/
+class LTBVM :public Action
+{
+public:
+	LTBVM(LTBDots *s, Pattern *host);
+
+	bool			load(const uint8_t *prog, size_t len, bool pgm = false);
+	inline void		restart() { pc = 0; sp = 0; wait = 0; tgt = pat; };
+	inline bool		done() { return code == NULL || fetch(pc) == VM_END; };
+
+	void			setDimAct(Pattern *pat, uint8_t tgt, ushort dur) {};
+	bool			timerTic(unsigned short deltaT);
+	inline uint8_t	actionType() { return SCRIPT; };
+	inline size_t	memSize() { return sizeof(*this); };
+
+protected:
+	inline uint8_t	fetch(uint16_t i) { return pgm ? pgm_read_byte(code + i) : code[i]; };
+	bool			exec();
+	void			fill(uint8_t s, uint8_t e);
+
+	LTBDots			*strip;
+	const uint8_t	*code;			// first instruction, after the header
+	uint16_t		pc;
+	bool			pgm;
+	Pattern			*tgt;			// pattern the instructions work on, may be NULL
+	RGB				clr;
+	uint8_t			a;
+	uint8_t			sp;				// loops open
+	uint16_t		loopPc[VM_STACK];
+	uint8_t			loopCnt[VM_STACK];	// runs left, 0 forever
+	int32_t			wait;			// msec left of VM_WAIT, below 0 carries the overshoot
+};
+
+#endif
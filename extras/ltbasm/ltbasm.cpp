@@ -0,0 +1,222 @@
+/*!
+* \file ltbasm.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* Host side assembler from effect program text to the bytecode run by LTBVM (see
+* LTBProg.h).
+*
+*	build:	g++ -O2 -o ltbasm ltbasm.cpp
+*	usage:	ltbasm prog.txt prog.bin			write the binary program
+*			ltbasm -c name prog.txt				print a PROGMEM C array to stdout
+*
+* Program text, one instruction per line, # starts a comment:
+*
+*	pat <i>				target the i'th pattern of the strip
+*	rgb <rrggbb>		set the color
+*	hue <h>				set the color from a hue, 0-255
+*	fill <s> <e|end>	fill pixels s..e of the target
+*	rotl <n>, rotr <n>	rotate the target
+*	dim <pct> <msec>	dimPat on the target
+*	wait <msec>			let the strip run for a while
+*	loop <n|forever>	repeat the lines up to the matching next
+*	next
+*	rand <n>			a = random 0..n-1 (0 means 256)
+*	seta <n>, adda <n>	set / add to a
+*	pixa				fill pixel a of the target
+*	huea				set the color from hue a
+*	end					stop, added at the end if missing
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../../LTBProg.h"
+
+#define MAXOUT		65535
+
+static uint8_t	code[MAXOUT];
+static size_t	codeLen;
+static int		depth;
+static int		lineNo;
+
+static const struct Mnemonic
+{
+	const char	*name;
+	uint8_t		op;
+	const char	*args;			// one letter per operand: b byte, w 16 bit, c color, e byte or "end", l count or "forever"
+} mnemonics[] = {
+	{ "end",	VM_END,		"" },
+	{ "pat",	VM_PAT,		"b" },
+	{ "rgb",	VM_RGB,		"c" },
+	{ "hue",	VM_HUE,		"b" },
+	{ "fill",	VM_FILL,	"be" },
+	{ "rotl",	VM_ROTL,	"b" },
+	{ "rotr",	VM_ROTR,	"b" },
+	{ "dim",	VM_DIM,		"bw" },
+	{ "wait",	VM_WAIT,	"w" },
+	{ "loop",	VM_LOOP,	"l" },
+	{ "next",	VM_NEXT,	"" },
+	{ "rand",	VM_RAND,	"b" },
+	{ "seta",	VM_SETA,	"b" },
+	{ "adda",	VM_ADDA,	"b" },
+	{ "pixa",	VM_PIXA,	"" },
+	{ "huea",	VM_HUEA,	"" },
+};
+
+static void
+fail(const char *msg, const char *arg)
+{
+	fprintf(stderr, "line %d: %s%s%s\n", lineNo, msg, arg ? " " : "", arg ? arg : "");
+	exit(1);
+}
+
+static void
+put(uint8_t b)
+{
+	if (codeLen >= MAXOUT - LTBP_HDRLEN)
+		fail("program too large", NULL);
+	code[codeLen++] = b;
+}
+
+static long
+number(const char *s, long lo, long hi)
+{
+	char *e;
+	long v = strtol(s, &e, 0);
+	if (*s == 0 || *e != 0 || v < lo || v > hi)
+		fail("bad number", s);
+	return v;
+}
+
+static void
+assemble(char *kw, char *args)
+{
+	const Mnemonic *m = NULL;
+	for (size_t i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i++)
+		if (strcmp(mnemonics[i].name, kw) == 0)
+			m = &mnemonics[i];
+	if (!m)
+		fail("unknown instruction", kw);
+
+	put(m->op);
+	char *tok = strtok(args, " \t");
+	for (const char *a = m->args; *a; a++, tok = strtok(NULL, " \t"))
+	{
+		if (!tok)
+			fail("missing operand for", kw);
+		if (*a == 'b')
+			put(number(tok, 0, 255));
+		else if (*a == 'e')
+			put(strcmp(tok, "end") == 0 ? 255 : number(tok, 0, 255));
+		else if (*a == 'l')
+			put(strcmp(tok, "forever") == 0 ? 0 : number(tok, 1, 255));
+		else if (*a == 'w')
+		{
+			long v = number(tok, 0, 65535);
+			put(v & 0xff);
+			put(v >> 8);
+		}
+		else
+		{
+			char *e;
+			unsigned long h = strtoul(tok, &e, 16);
+			if (*e != 0 || strlen(tok) != 6)
+				fail("bad color", tok);
+			put((h >> 16) & 0xff);
+			put((h >> 8) & 0xff);
+			put(h & 0xff);
+		}
+	}
+	if (tok)
+		fail("extra operand", tok);
+
+	if (m->op == VM_LOOP && ++depth > VM_STACK)
+		fail("loops nested too deep", NULL);
+	if (m->op == VM_NEXT && depth-- == 0)
+		fail("next without loop", NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *cname = NULL, *inName, *outName = NULL;
+	char line[4096];
+	uint8_t last = VM_NOPS;
+
+	if (argc == 4 && strcmp(argv[1], "-c") == 0)
+	{
+		cname = argv[2];
+		inName = argv[3];
+	}
+	else if (argc == 3)
+	{
+		inName = argv[1];
+		outName = argv[2];
+	}
+	else
+	{
+		fprintf(stderr, "usage: ltbasm prog.txt prog.bin\n       ltbasm -c name prog.txt\n");
+		return 2;
+	}
+
+	FILE *in = fopen(inName, "r");
+	if (!in)
+	{
+		perror(inName);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), in))
+	{
+		lineNo++;
+		char *hash = strchr(line, '#');
+		if (hash)
+			*hash = 0;
+		line[strcspn(line, "\r\n")] = 0;
+
+		char *kw = line + strspn(line, " \t");
+		if (*kw == 0)
+			continue;
+		char *args = kw + strcspn(kw, " \t");
+		if (*args)
+			*args++ = 0;
+		size_t at = codeLen;
+		assemble(kw, args);
+		last = code[at];
+	}
+	fclose(in);
+	if (depth)
+		fail("loop without next", NULL);
+	if (last != VM_END)
+		put(VM_END);
+
+	/**  header, then the code **/
+	static uint8_t out[MAXOUT];
+	size_t n = 0;
+	memcpy(out, LTBP_MAGIC, 4);
+	out[4] = LTBP_VERSION;
+	out[5] = out[6] = out[7] = 0;
+	n = LTBP_HDRLEN;
+	memcpy(out + n, code, codeLen);
+	n += codeLen;
+
+	if (cname)
+	{
+		printf("// generated by ltbasm from %s\n", inName);
+		printf("const uint8_t %s[%u] PROGMEM = {", cname, (unsigned)n);
+		for (size_t i = 0; i < n; i++)
+			printf("%s0x%02x,", (i % 12) ? " " : "\n\t", out[i]);
+		printf("\n};\n");
+		return 0;
+	}
+
+	FILE *of = fopen(outName, "wb");
+	if (!of || fwrite(out, 1, n, of) != n || fclose(of) != 0)
+	{
+		perror(outName);
+		return 1;
+	}
+	return 0;
+}
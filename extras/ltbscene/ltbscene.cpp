@@ -0,0 +1,276 @@
+/*!
+* \file ltbscene.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* Host side compiler from a text scene description to the binary format read by
+* LTBDots::loadScene (see LTBScene.h).
+*
+*	build:	g++ -O2 -o ltbscene ltbscene.cpp
+*	usage:	ltbscene scene.txt scene.bin			write the binary scene
+*			ltbscene -c name scene.txt				print a PROGMEM C array to stdout
+*
+* Scene text, one statement per line, # starts a comment:
+*
+*	palette <name> <rrggbb> ...						define a named color list
+*	pat <palette>[:<off>] [pix=N] [reps=N] [on=P]	pixPat of N colors starting at off
+*	trans <palette>[:<off>] reps=N [on=P]			RTPat ramp from color off to off+1
+*	dim <tgt> <msec>								dimPat on the last pattern, up to 32767 msec
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../../LTBScene.h"
+
+#define MAXPAL		255
+#define MAXOUT		65536
+
+struct Palette
+{
+	char		name[32];
+	uint8_t		n;
+	uint8_t		rgb[255 * 3];
+};
+
+static Palette	pals[MAXPAL];
+static int		nPal;
+static uint8_t	patBuf[MAXOUT];			// pattern and action records, appended after the palettes
+static size_t	patLen;
+static int		nPat;
+static int		lastPat = -1;			// offset of the last pattern record, for dim
+static int		lineNo;
+
+static void
+fail(const char *msg, const char *arg)
+{
+	fprintf(stderr, "line %d: %s%s%s\n", lineNo, msg, arg ? " " : "", arg ? arg : "");
+	exit(1);
+}
+
+static void
+put(uint8_t b)
+{
+	if (patLen >= MAXOUT)
+		fail("scene too large", NULL);
+	patBuf[patLen++] = b;
+}
+
+static int
+findPal(const char *name)
+{
+	for (int i = 0; i < nPal; i++)
+		if (strcmp(pals[i].name, name) == 0)
+			return i;
+	fail("unknown palette", name);
+	return -1;
+}
+
+static long
+number(const char *s, long lo, long hi)
+{
+	char *e;
+	long v = strtol(s, &e, 0);
+	if (*s == 0 || *e != 0 || v < lo || v > hi)
+		fail("bad number", s);
+	return v;
+}
+
+static void
+doPalette(char *args)
+{
+	char *tok = strtok(args, " \t");
+	if (!tok)
+		fail("palette needs a name", NULL);
+	if (nPal == MAXPAL)
+		fail("too many palettes", NULL);
+
+	Palette *p = &pals[nPal++];
+	strncpy(p->name, tok, sizeof(p->name) - 1);
+	p->n = 0;
+	while ((tok = strtok(NULL, " \t")) != NULL)
+	{
+		char *e;
+		unsigned long h = strtoul(tok, &e, 16);
+		if (*e != 0 || strlen(tok) != 6)
+			fail("bad color", tok);
+		if (p->n == 255)
+			fail("too many colors in palette", p->name);
+		p->rgb[p->n * 3 + 0] = (h >> 16) & 0xff;
+		p->rgb[p->n * 3 + 1] = (h >> 8) & 0xff;
+		p->rgb[p->n * 3 + 2] = h & 0xff;
+		p->n++;
+	}
+	if (p->n == 0)
+		fail("empty palette", p->name);
+}
+
+static void
+doPattern(char *args, uint8_t type)
+{
+	char *tok = strtok(args, " \t");
+	if (!tok)
+		fail("pattern needs a palette", NULL);
+
+	long off = 0, pix = -1, reps = 1, on = 100;
+	char *colon = strchr(tok, ':');
+	if (colon)
+	{
+		*colon = 0;
+		off = number(colon + 1, 0, 254);
+	}
+	int pi = findPal(tok);
+
+	while ((tok = strtok(NULL, " \t")) != NULL)
+	{
+		if (strncmp(tok, "pix=", 4) == 0)
+			pix = number(tok + 4, 1, 255);
+		else if (strncmp(tok, "reps=", 5) == 0)
+			reps = number(tok + 5, 1, 65535);
+		else if (strncmp(tok, "on=", 3) == 0)
+			on = number(tok + 3, 0, 100);
+		else
+			fail("unknown option", tok);
+	}
+
+	if (type == LTBS_RTPAT)
+	{
+		pix = 2;
+		if (reps < 2)
+			fail("trans needs reps=2 or more", NULL);
+	}
+	else if (pix < 0)
+		pix = pals[pi].n - off;
+	if (off >= pals[pi].n || pix <= 0)
+		fail("offset past end of palette", pals[pi].name);
+	if (off + pix > pals[pi].n)
+		fail("pattern runs past end of palette", pals[pi].name);
+
+	lastPat = patLen;
+	put(type);
+	put(pi);
+	put(off);
+	put(pix);
+	put(reps & 0xff);
+	put(reps >> 8);
+	put(on);
+	put(0);								// action count, bumped by dim
+	nPat++;
+	if (nPat > 255)
+		fail("too many patterns", NULL);
+}
+
+static void
+doDim(char *args)
+{
+	char *tgt = strtok(args, " \t");
+	char *dur = strtok(NULL, " \t");
+	if (!tgt || !dur)
+		fail("dim needs a target and a duration", NULL);
+	if (lastPat < 0)
+		fail("dim before any pattern", NULL);
+	if (patBuf[lastPat + 7] == 255)
+		fail("too many actions", NULL);
+
+	long d = number(dur, 0, LTBS_MAXDUR);
+	put(LTBS_ACT_DIM);
+	put(number(tgt, 0, 100));
+	put(d & 0xff);
+	put(d >> 8);
+	patBuf[lastPat + 7]++;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *cname = NULL, *inName, *outName = NULL;
+	char line[4096];
+
+	if (argc == 4 && strcmp(argv[1], "-c") == 0)
+	{
+		cname = argv[2];
+		inName = argv[3];
+	}
+	else if (argc == 3)
+	{
+		inName = argv[1];
+		outName = argv[2];
+	}
+	else
+	{
+		fprintf(stderr, "usage: ltbscene scene.txt scene.bin\n       ltbscene -c name scene.txt\n");
+		return 2;
+	}
+
+	FILE *in = fopen(inName, "r");
+	if (!in)
+	{
+		perror(inName);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), in))
+	{
+		lineNo++;
+		char *hash = strchr(line, '#');
+		if (hash)
+			*hash = 0;
+		line[strcspn(line, "\r\n")] = 0;
+
+		char *kw = line + strspn(line, " \t");
+		if (*kw == 0)
+			continue;
+		char *args = kw + strcspn(kw, " \t");
+		if (*args)
+			*args++ = 0;
+
+		if (strcmp(kw, "palette") == 0)
+			doPalette(args);
+		else if (strcmp(kw, "pat") == 0)
+			doPattern(args, LTBS_PIXPAT);
+		else if (strcmp(kw, "trans") == 0)
+			doPattern(args, LTBS_RTPAT);
+		else if (strcmp(kw, "dim") == 0)
+			doDim(args);
+		else
+			fail("unknown statement", kw);
+	}
+	fclose(in);
+
+	/**  assemble header, palettes, then the pattern records **/
+	static uint8_t out[LTBS_HDRLEN + MAXPAL * (1 + 255 * 3) + MAXOUT];
+	size_t n = 0;
+	memcpy(out, LTBS_MAGIC, 4);
+	out[4] = LTBS_VERSION;
+	out[5] = nPal;
+	out[6] = nPat;
+	out[7] = 0;
+	n = LTBS_HDRLEN;
+	for (int i = 0; i < nPal; i++)
+	{
+		out[n++] = pals[i].n;
+		memcpy(out + n, pals[i].rgb, pals[i].n * 3);
+		n += pals[i].n * 3;
+	}
+	memcpy(out + n, patBuf, patLen);
+	n += patLen;
+
+	if (cname)
+	{
+		printf("// generated by ltbscene from %s\n", inName);
+		printf("const uint8_t %s[%u] PROGMEM = {", cname, (unsigned)n);
+		for (size_t i = 0; i < n; i++)
+			printf("%s0x%02x,", (i % 12) ? " " : "\n\t", out[i]);
+		printf("\n};\n");
+		return 0;
+	}
+
+	FILE *of = fopen(outName, "wb");
+	if (!of || fwrite(out, 1, n, of) != n || fclose(of) != 0)
+	{
+		perror(outName);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,1341 @@
+/*!
+* \file ltbtest.cpp
+*
+* \author Kevin Wilson
+* \date
+*
+* Host side checks and benchmarks for the library, built against the Arduino stand-ins
+* in shim/.  Frames are captured with a DotsOut and time comes from a ManualClock, so
+* the checks give the same answer on any host; benchmarks print their timings.
+*
+*	build:	g++ -O2 -DARDUINO=10800 -Ishim -I../.. -o ltbtest ltbtest.cpp ../../LTB*.cpp
+*	usage:	ltbtest					run every check
+*			ltbtest name ...		run the named checks
+*
+* Each check prints ok or FAIL and what went wrong.  The exit status is the number of
+* checks that failed.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "LTBDots.h"
+#include "LTBScene.h"
+#include "LTBIngest.h"
+#include "LTBMatrix.h"
+#include "LTBVM.h"
+#include "LTBSync.h"
+#include "LTBAudio.h"
+#include "LTBSpidev.h"
+
+HardwareSerial	Serial;
+SPIClass		SPI;
+
+#define CAPMAX		65536
+
+static volatile uint32_t	sink;			// keeps timed work from being optimised away
+
+/**
+**  The Arduino core, from the host's clock
+**/
+static uint64_t
+hostUs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned long
+millis()
+{
+	return hostUs() / 1000;
+}
+
+unsigned long
+micros()
+{
+	return hostUs();
+}
+
+long
+random(long n)
+{
+	return n > 0 ? rand() % n : 0;
+}
+
+long
+random(long lo, long hi)
+{
+	return hi > lo ? lo + rand() % (hi - lo) : lo;
+}
+
+void
+delay(unsigned long ms)
+{
+	struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+
+	nanosleep(&ts, NULL);
+}
+
+/*!
+* \class Capture
+*
+* \brief DotsOut that keeps the bytes of the last frame
+*
+* \author Kevin Wilson
+* \date
+*/
+class Capture :public DotsOut
+{
+public:
+	Capture() { len = 0; frames = 0; done = false; };
+
+	void			write(const uint8_t *p, size_t n) { start(); if (len + n <= CAPMAX) memcpy(buf + len, p, n); len += n; };
+	void			zeros(size_t n) { start(); if (len + n <= CAPMAX) memset(buf + len, 0, n); len += n; };
+	void			endFrame() { frames++; done = true; };
+
+	uint8_t			buf[CAPMAX];
+	size_t			len;			// bytes of the last frame, may be more than CAPMAX
+	uint32_t		frames;
+
+protected:
+	inline void		start() { if (done) len = 0; done = false; };
+
+	bool			done;			// the next write starts a new frame
+};
+
+/************************************************************************/
+/* This function prints why a check failed, returns false               */
+/************************************************************************/
+static bool
+fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("\t");
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+	return false;
+}
+
+/************************************************************************/
+/* This function compares a captured frame to the bytes expected        */
+/************************************************************************/
+static bool
+sameBytes(const char *what, Capture &c, const uint8_t *want, size_t n)
+{
+	if (c.len != n)
+		return fail("%s: %u bytes, expected %u", what, (unsigned)c.len, (unsigned)n);
+	for (size_t i = 0; i < n; i++)
+		if (c.buf[i] != want[i])
+			return fail("%s: byte %u is %02x, expected %02x", what, (unsigned)i, c.buf[i], want[i]);
+	return true;
+}
+
+/************************************************************************/
+/* This function checks every pixel of an LV_PIX APA102 frame is r g b  */
+/************************************************************************/
+#define LV_PIX		10
+
+static bool
+lvlBytes(const char *what, Capture &c, uint8_t r, uint8_t g, uint8_t b)
+{
+	for (uint16_t i = 0; i < LV_PIX; i++)
+	{
+		const uint8_t *q = c.buf + 4 + i * 4;		// APA102 leader, then header, b, g, r
+		if (q[1] != b || q[2] != g || q[3] != r)
+			return fail("%s: pixel %u is %u %u %u, expected %u %u %u", what, i, q[3], q[2], q[1], r, g, b);
+	}
+	return true;
+}
+
+//
+/*** checks *****/
+//
+
+static RGB goldPal[3] = { CLR(1, 2, 3), CLR(4, 5, 6), CLRH(0x070809) };
+static const uint8_t goldApa[] = { 0, 0, 0, 0, 0xff, 3, 2, 1, 0xff, 6, 5, 4, 0xff, 9, 8, 7, 0 };
+
+/**
+**  Three pixels of distinct channels through each format, every byte of the frame
+**  checked: leader, header byte, channel order and end frame.
+**/
+static bool
+chkGolden()
+{
+	static const uint8_t sk[] = { 0, 0, 0, 0, 0xff, 3, 2, 1, 0xff, 6, 5, 4, 0xff, 9, 8, 7, 0, 0, 0, 0, 0 };
+	static const uint8_t ws[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+	static const struct { uint8_t fmt; const char *name; const uint8_t *want; size_t n; } golden[] = {
+		{ PIX_APA102, "APA102", goldApa, sizeof(goldApa) },
+		{ PIX_SK9822, "SK9822", sk, sizeof(sk) },
+		{ PIX_WS2801, "WS2801", ws, sizeof(ws) },
+	};
+	bool ok = true;
+
+	if (goldPal[2].r != 7 || goldPal[2].g != 8 || goldPal[2].b != 9)
+		ok = fail("CLRH(0x070809) is %d %d %d", goldPal[2].r, goldPal[2].g, goldPal[2].b);
+	for (uint8_t i = 0; i < sizeof(golden) / sizeof(golden[0]); i++)
+	{
+		Capture c;
+		LTBDots d(3, golden[i].fmt);
+
+		d.setOutput(&c);
+		d.addPat(goldPal, 3, 1);
+		d.showLights(true);
+		if (!sameBytes(golden[i].name, c, golden[i].want, golden[i].n))
+			ok = false;
+	}
+	return ok;
+}
+
+/**
+**  The golden APA102 frame through SpidevOut's file fallback: rendered into a temp
+**  file, which must then hold the golden bytes, and no errors counted.
+**/
+static bool
+chkSpidev()
+{
+	char name[] = "/tmp/ltbtestXXXXXX";
+	uint8_t got[sizeof(goldApa) + 1];
+	int fd = mkstemp(name);
+	bool ok = true;
+
+	if (fd < 0)
+		return fail("no temp file");
+	close(fd);
+	{
+		SpidevOut o(name);
+		LTBDots d(3);
+
+		if (!o.begin() || o.isSpidev())
+			ok = fail("%s did not open as a plain file", name);
+		d.setOutput(&o);
+		d.addPat(goldPal, 3, 1);
+		d.showLights(true);
+		if (o.getErrors())
+			ok = fail("%u errors, errno %d", (unsigned)o.getErrors(), o.getErrno());
+	}
+
+	FILE *f = fopen(name, "rb");
+	size_t n = f ? fread(got, 1, sizeof(got), f) : 0;
+	if (f)
+		fclose(f);
+	unlink(name);
+	if (n != sizeof(goldApa))
+		ok = fail("%u bytes in the file, expected %u", (unsigned)n, (unsigned)sizeof(goldApa));
+	else if (memcmp(got, goldApa, n) != 0)
+		ok = fail("file bytes differ from the golden frame");
+	return ok;
+}
+
+/**
+**  The poke then fillPat idiom through editCol: the edit reaches the wire, the caller's
+**  array is left alone, and the private copy shows in memUsage as colorCost bytes.
+**/
+static bool
+chkEditCol()
+{
+	static RGB pal[3] = { CLR(1, 2, 3), CLR(4, 5, 6), CLR(7, 8, 9) };
+	Capture c;
+	LTBDots d(3);
+	LTBMem m0, m1;
+	bool ok = true;
+
+	d.setOutput(&c);
+	Pattern *p = d.addPat(pal, 3, 1);
+	memset(&m0, 0, sizeof(m0));
+	memset(&m1, 0, sizeof(m1));
+	p->memUsage(m0);
+	*p->editCol(1) = CLR(40, 50, 60);
+	p->fillPat(CLR(70, 80, 90), 2, 2);
+	p->memUsage(m1);
+	d.showLights(true);
+	const uint8_t *q = c.buf + 4;
+	if (q[5] != 60 || q[6] != 50 || q[7] != 40 || q[9] != 90 || q[10] != 80 || q[11] != 70)
+		ok = fail("edits not shown: %u %u %u, %u %u %u", q[7], q[6], q[5], q[11], q[10], q[9]);
+	if (pal[1].r != 4 || pal[2].r != 7)
+		ok = fail("the caller's array was written");
+	if (m1.buffers - m0.buffers != pixPat::colorCost(3))
+		ok = fail("copy took %u bytes, colorCost says %u", (unsigned)(m1.buffers - m0.buffers),
+			(unsigned)pixPat::colorCost(3));
+	return ok;
+}
+
+/**
+**  Frame length for strips from 1 to 65535 pixels: leader, pixels and the shortest
+**  end frame that latches, ceil(n / 16) bytes for APA102 and 4 more for SK9822's reset
+**  frame, and nothing else.  The frame buffer has to be exactly the pixels too.
+**/
+static bool
+chkTrailer()
+{
+	static RGB pal[1] = { CLR(10, 20, 30) };
+	static const uint16_t lens[] = { 1, 15, 16, 17, 255, 256, 4095, 4096, 4097, 16383, 65535 };
+	static const uint8_t fmts[] = { PIX_APA102, PIX_SK9822, PIX_WS2801 };
+	bool ok = true;
+
+	for (uint8_t f = 0; f < sizeof(fmts); f++)
+		for (uint8_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+		{
+			uint32_t n = lens[i], bpp = PIX_BPP(fmts[f]);
+			uint32_t end = fmts[f] == PIX_WS2801 ? 0 : (n + 15) / 16 + (fmts[f] == PIX_SK9822 ? 4 : 0);
+			uint32_t want = (bpp == 4 ? 4 : 0) + n * bpp + end;
+			Capture c;
+			LTBDots d(n, fmts[f]);
+			LTBMem m;
+
+			d.setOutput(&c);
+			d.addPat(pal, 1, n);
+			d.showLights(true);
+			d.getMemUsage(m);
+			if (c.len != want)
+				ok = fail("fmt %d, %u pixels: %u bytes sent, expected %u", fmts[f], n, (unsigned)c.len, want);
+			else if (m.frames != n * bpp)
+				ok = fail("fmt %d, %u pixels: %u byte frame buffer, expected %u", fmts[f], n, (unsigned)m.frames, n * bpp);
+			else if (want <= CAPMAX)
+				for (uint32_t j = want - end; j < want; j++)
+					if (c.buf[j] != 0)
+					{
+						ok = fail("fmt %d, %u pixels: end frame byte %u is %02x", fmts[f], n, j, c.buf[j]);
+						break;
+					}
+		}
+	return ok;
+}
+
+/**
+**  A scene with a pattern at on=50 and a dim to 0 over 100 msec, through loadScene:
+**  the first frame at half brightness, dark once the dim has run.  A dim longer than
+**  LTBS_MAXDUR must not load.
+**/
+static bool
+chkScene()
+{
+	static const uint8_t scene[] = {
+		'L', 'T', 'B', 'S', LTBS_VERSION, 1, 1, 0,
+		1, 200, 100, 50,
+		LTBS_PIXPAT, 0, 0, 1, LV_PIX, 0, 50, 1,
+		LTBS_ACT_DIM, 0, 100, 0
+	};
+	static uint8_t buf[256];
+	uint8_t bad[sizeof(scene)];
+	Capture c;
+	ManualClock clk;
+	LTBDots d(LV_PIX);
+	bool ok = true;
+
+	d.setOutput(&c);
+	d.setClock(&clk);
+	if (!d.loadScene(scene, sizeof(scene), buf, sizeof(buf)))
+		return fail("scene did not load");
+	d.showLights(true);
+	if (!lvlBytes("on=50", c, 100, 50, 25))
+		ok = false;
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		clk.tick(10);
+		d.showLights();
+	}
+	if (!lvlBytes("dimmed to 0", c, 0, 0, 0))
+		ok = false;
+
+	memcpy(bad, scene, sizeof(scene));
+	bad[sizeof(bad) - 2] = (LTBS_MAXDUR + 1) & 0xff;
+	bad[sizeof(bad) - 1] = (LTBS_MAXDUR + 1) >> 8;
+	if (d.loadScene(bad, sizeof(bad), buf, sizeof(buf)))
+		ok = fail("a %u msec dim loaded", LTBS_MAXDUR + 1);
+	return ok;
+}
+
+/**
+**  A fade stopped part way leaves fractions for setDither, then a rotate writes the
+**  colors.  The dithered frames must follow the rotate: with the fraction gone they
+**  are the same bytes as the plain frame, on every frame of the dither cycle.
+**/
+static bool
+chkDither()
+{
+	static RGB pal[4] = { CLR(0, 0, 0), CLR(40, 80, 120), CLR(200, 10, 0), CLR(3, 5, 7) };
+	static RGB end[4] = { CLR(100, 0, 33), CLR(0, 255, 1), CLR(17, 17, 17), CLR(90, 1, 60) };
+	uint8_t plain[4 + 4 * 4 + 1];
+	Capture c;
+	LTBDots d(4);
+	bool ok = true;
+
+	d.setOutput(&c);
+	Pattern *p = d.addPat(pal, 4, 1);
+	p->initFader(end, 7);
+	for (uint8_t i = 0; i < 3; i++)
+		p->stepFader();
+	p->rotateLeft(1);
+	d.showLights(true);
+	if (c.len != sizeof(plain))
+		return fail("%u bytes sent, expected %u", (unsigned)c.len, (unsigned)sizeof(plain));
+	memcpy(plain, c.buf, sizeof(plain));
+
+	d.setDither(true);
+	for (uint8_t fr = 0; fr < 16 && ok; fr++)
+	{
+		d.showLights(true);
+		if (!sameBytes("dithered after rotateLeft", c, plain, sizeof(plain)))
+			ok = fail("frame %u", fr);
+	}
+	return ok;
+}
+
+
+/**
+**  setFrameSkip: an unchanged frame is not sent again until the keepalive, a changed
+**  one is sent at once, and a keepalive of 0 is refused.
+**/
+static bool
+chkSkip()
+{
+	static RGB pal[2] = { CLR(10, 20, 30), CLR(40, 50, 60) };
+	Capture c;
+	ManualClock clk;
+	LTBDots d(LV_PIX);
+	bool ok = true;
+
+	d.setOutput(&c);
+	d.setClock(&clk);
+	Pattern *p = d.addPat(pal, 2, LV_PIX / 2);
+	if (d.setFrameSkip(true, 0))
+		ok = fail("keepalive 0 accepted");
+	if (!d.setFrameSkip(true, 1000))
+		ok = fail("keepalive 1000 refused");
+	for (uint16_t t = 0; t < 2500; t += 10)
+	{
+		if (t == 1200)
+			p->rotateLeft(1);
+		d.renderFrame(true);
+		d.sendFrame();
+		clk.tick(10);
+	}
+	// sent at 0, 1000, 1200 (changed), 2200 (keepalive)
+	if (c.frames != 4)
+		ok = fail("%u frames sent of 250, expected 4", c.frames);
+	return ok;
+}
+
+/************************************************************************/
+/* This function builds an E1.31 data packet of n slots, returns its    */
+/* length                                                               */
+/************************************************************************/
+static uint16_t
+e131Packet(uint8_t *pkt, uint16_t uni, uint8_t seq, const uint8_t *d, uint16_t n)
+{
+	memset(pkt, 0, 126);
+	pkt[1] = 0x10;
+	memcpy(pkt + 4, "ASC-E1.17\0\0\0", 12);
+	pkt[21] = 0x04;								// root vector, data
+	pkt[43] = 0x02;								// framing vector, DMP
+	pkt[111] = seq;
+	pkt[113] = uni >> 8;
+	pkt[114] = uni;
+	pkt[117] = 0x02;
+	pkt[118] = 0xa1;
+	pkt[123] = (n + 1) >> 8;					// slots and the start code
+	pkt[124] = n + 1;
+	memcpy(pkt + 126, d, n);
+	return 126 + n;
+}
+
+/**
+**  Four E1.31 universes of 170 pixels each go through a UDP socket on the loopback
+**  interface (or straight from memory where there is none), into LTBIngest and out
+**  through sendFrame.  Every frame sent is checked against the DMX data, and the time
+**  from the first packet sent to the frame going out is the latency.  Last, a white
+**  frame against a power budget must go out with the APA102 brightness lowered.
+**/
+#define ING_UNI		4
+#define ING_PIX		170
+#define ING_FRAMES	2000
+#define ING_BUDGET	5000		// mA, well under a white frame
+
+static bool
+chkIngest()
+{
+	static uint8_t d[ING_UNI][ING_PIX * 3];
+	uint8_t pkt[638];
+	struct sockaddr_in a;
+	socklen_t al = sizeof(a);
+	struct timeval tv = { 1, 0 };
+	uint64_t start, total = 0, worst = 0;
+	Capture c;
+	LTBDots strip(ING_UNI * ING_PIX);
+	LTBIngest ing(&strip);
+	bool ok = true;
+
+	strip.setOutput(&c);
+	for (uint8_t u = 0; u < ING_UNI; u++)
+		ing.mapUniverse(u + 1, u * ING_PIX, ING_PIX);
+
+	int rx = socket(AF_INET, SOCK_DGRAM, 0), tx = socket(AF_INET, SOCK_DGRAM, 0);
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bool loop = rx >= 0 && tx >= 0 && bind(rx, (struct sockaddr *)&a, sizeof(a)) == 0 &&
+		getsockname(rx, (struct sockaddr *)&a, &al) == 0 &&
+		setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+
+	start = hostUs();
+	for (uint32_t f = 0; f < ING_FRAMES && ok; f++)
+	{
+		uint64_t t0 = hostUs();
+		for (uint8_t u = 0; u < ING_UNI; u++)
+		{
+			for (uint16_t i = 0; i < ING_PIX * 3; i++)
+				d[u][i] = f * 7 + u * 31 + i;
+			uint16_t n = e131Packet(pkt, u + 1, f, d[u], ING_PIX * 3);
+			if (!loop)
+				ing.parse(pkt, n);
+			else if (sendto(tx, pkt, n, 0, (struct sockaddr *)&a, sizeof(a)) != n)
+				ok = fail("sendto failed");
+		}
+		for (uint8_t u = 0; u < ING_UNI && loop && ok; u++)
+		{
+			ssize_t n = recv(rx, pkt, sizeof(pkt), 0);
+			if (n <= 0)
+				ok = fail("frame %u: packet %d lost on loopback", f, u);
+			else
+				ing.parse(pkt, n);
+		}
+		strip.sendFrame();
+		uint64_t t = hostUs() - t0;
+		total += t;
+		if (t > worst)
+			worst = t;
+
+		for (uint16_t j = 0; j < ING_UNI * ING_PIX && ok; j++)
+		{
+			const uint8_t *w = d[j / ING_PIX] + (j % ING_PIX) * 3, *g = c.buf + 4 + j * 4;
+			if (g[0] != 0xff || g[3] != w[0] || g[2] != w[1] || g[1] != w[2])
+				ok = fail("frame %u: pixel %u is %02x %02x %02x %02x", f, j, g[0], g[1], g[2], g[3]);
+		}
+	}
+	double secs = (hostUs() - start) / 1e6;
+
+	uint16_t n = e131Packet(pkt, 2, (uint8_t)(ING_FRAMES - 3), d[1], ING_PIX * 3);		// late duplicate
+	if (ok && ing.parse(pkt, n) != INGEST_STALE)
+		ok = fail("an old sequence number was not dropped");
+	const LTBIngestStats &st = ing.getStats();
+	if (ok && (st.frames != ING_FRAMES || st.bad || st.stale != 1))
+		ok = fail("%u frames published, %u bad, %u stale", st.frames, st.bad, st.stale);
+
+	strip.setPowerBudget(ING_BUDGET);				// a full white frame from the console
+	memset(d, 255, sizeof(d));
+	for (uint8_t u = 0; u < ING_UNI; u++)
+		ing.parse(pkt, e131Packet(pkt, u + 1, (uint8_t)ING_FRAMES, d[u], ING_PIX * 3));
+	strip.sendFrame();
+	uint32_t full = (uint32_t)ING_UNI * ING_PIX * (MA_IDLE + 3 * MA_PER_CHAN);
+	if (ok && (strip.getPowerEst() != full || strip.getPowerScale() >= 31 || c.buf[4] != (0xe0 | strip.getPowerScale())))
+		ok = fail("white at %u mA against %u: estimate %u mA, scale %u, header %02x", (unsigned)full, ING_BUDGET,
+			(unsigned)strip.getPowerEst(), strip.getPowerScale(), c.buf[4]);
+	if (rx >= 0)
+		close(rx);
+	if (tx >= 0)
+		close(tx);
+
+	printf("\t%u frames of %u universes %s: %.1f us per frame, %.1f worst, %.0f packets/s\n",
+		ING_FRAMES, ING_UNI, loop ? "over loopback UDP" : "replayed from memory",
+		(double)total / ING_FRAMES, (double)worst, ING_FRAMES * ING_UNI / secs);
+	return ok;
+}
+
+
+/************************************************************************/
+/* This function folds n bytes into an FNV-1a hash                      */
+/************************************************************************/
+static uint32_t
+hashBytes(uint32_t h, const uint8_t *p, size_t n)
+{
+	while (n--)
+		h = (h ^ *p++) * 16777619u;
+	return h;
+}
+
+/**
+**  100k frames of a scene with procedural patterns, particles and a dim, driven by a
+**  ManualClock with uneven frame times at 1.5x speed, a pause and a 10 msec fixed step.
+**  Run twice, every frame's bytes must hash the same, and effect time must be exactly
+**  the scaled clock time with nothing lost to rounding.  The dim takes the first pixel's
+**  red from 255 down to 20% in steps, never back up.
+**/
+#define MAN_FRAMES	100000
+#define MAN_PIX		300
+
+static uint32_t
+manualRun(uint32_t &simMs, uint32_t &expect, double &secs, uint8_t &red, uint16_t &steps, bool &rose)
+{
+	static RGB pal[3] = { CLR(255, 0, 0), CLR(0, 255, 0), CLR(0, 0, 255) };
+	uint32_t h = 2166136261u, lcg = 1, real = 0;
+	uint64_t start;
+	uint8_t r;
+	Capture c;
+	ManualClock clk;
+	LTBDots d(MAN_PIX);
+
+	srand(1);									// sparkle spawns
+	d.setOutput(&c);
+	d.setClock(&clk);
+	d.setTimestep(10);
+	d.setSpeed(TIME_1X * 3 / 2);
+	d.addPat(pal, 3, 20)->dimPat(20, 30000);
+	d.addHue(100, 300, 50);
+	d.addNoise(pal, 3, 60, 40, 100);
+	Pattern *sp = d.addSparkle(NULL, 80, 16, pal, 3);
+	((sparklePat *)sp)->setSpawn(20, 800, 200);
+
+	red = 255;
+	steps = 0;
+	rose = false;
+	start = hostUs();
+	for (uint32_t f = 0; f < MAN_FRAMES; f++)
+	{
+		uint32_t dt;
+
+		lcg = lcg * 1103515245u + 12345;
+		dt = 5 + (lcg >> 16) % 21;				// 5 to 25 msec
+		d.pause(f >= 40000 && f < 50000);
+		if (f < 40000 || f >= 50000)
+			real += dt;
+		clk.tick(dt);
+		d.showLights();
+		h = hashBytes(h, c.buf, c.len);
+		if ((r = c.buf[4 + 3]) != red)			// APA102: leader, then header, b, g, r
+		{
+			rose |= r > red;
+			steps++;
+			red = r;
+		}
+	}
+	secs = (hostUs() - start) / 1e6;
+	simMs = d.getTime();
+	expect = (uint64_t)real * 3 / 2;
+	return h;
+}
+
+static bool
+chkManual()
+{
+	uint32_t ms[2], want[2];
+	double secs[2];
+	uint8_t red[2];
+	uint16_t steps[2];
+	bool rose[2];
+	uint32_t h0 = manualRun(ms[0], want[0], secs[0], red[0], steps[0], rose[0]);
+	uint32_t h1 = manualRun(ms[1], want[1], secs[1], red[1], steps[1], rose[1]);
+	bool ok = true;
+
+	if (h0 != h1)
+		ok = fail("runs differ, hash %08x then %08x", h0, h1);
+	if (ms[0] != want[0] || ms[1] != want[1])
+		ok = fail("effect time %u msec, expected %u", ms[0], want[0]);
+	if (red[0] != 51 || steps[0] < 50 || rose[0])
+		ok = fail("dim: red ends at %u after %u steps%s, expected 51 in 50 or more going down",
+			red[0], steps[0], rose[0] ? ", some up" : "");
+	printf("\t%u frames of %u pixels, %u msec of effect time, hash %08x: %.0f frames/s\n",
+		MAN_FRAMES, MAN_PIX, ms[0], h0, MAN_FRAMES / secs[0]);
+	printf("\tdim to 20%%: first pixel red 255 to %u in %u steps\n", red[0], steps[0]);
+	return ok;
+}
+
+
+/**
+**  Short periods repeated along a long strip, the common layout: pixPat's fill (one
+**  period, then doubling copies) against writing every pixel, and clearLights.  The
+**  bytes must match the per pixel reference; the times are per pixel.
+**/
+#define FILL_PIX	4096
+#define FILL_REPS	2000
+
+static bool
+chkFill()
+{
+	static RGB pal[32];
+	static uint8_t buf[FILL_PIX * 4], ref[FILL_PIX * 4];
+	static const uint8_t periods[] = { 1, 2, 3, 8, 32 };
+	bool ok = true;
+
+	for (uint8_t i = 0; i < 32; i++)
+		pal[i] = CLR((uint8_t)(i * 30), (uint8_t)(255 - i * 30), (uint8_t)(i * 7));
+	for (uint8_t k = 0; k < sizeof(periods); k++)
+	{
+		uint8_t np = periods[k];
+		pixPat pat(pal, np, FILL_PIX / np, 100);
+		Pattern *volatile pp = &pat;				// a real call, as from the strip
+		uint16_t n = pat.pixLen();
+		LTBFill f = { PIX_APA102, 0 };
+		uint64_t t0, t1, t2;
+
+		t0 = hostUs();
+		for (uint16_t r = 0; r < FILL_REPS; r++)
+		{
+			pp->fillRGB(buf, f);
+			sink += buf[(r * 97u) % (n * 4u)];
+		}
+		t1 = hostUs();
+		for (uint16_t r = 0; r < FILL_REPS; r++)
+		{
+			uint8_t *p = ref;
+			for (uint16_t j = 0; j < n; j++)
+				p = FmtAPA102::put(p, pal[j % np]);
+			sink += ref[(r * 97u) % (n * 4u)];
+		}
+		t2 = hostUs();
+		if (memcmp(buf, ref, (size_t)n * 4) != 0)
+			ok = fail("period %u: fill differs from the per pixel reference", np);
+		printf("\tperiod %2u x %4u: fill %.2f ns/pixel, per pixel loop %.2f ns/pixel\n", np, n / np,
+			(t1 - t0) * 1e3 / ((double)FILL_REPS * n), (t2 - t1) * 1e3 / ((double)FILL_REPS * n));
+	}
+
+	Capture c;
+	LTBDots d(FILL_PIX);
+	d.setOutput(&c);
+	uint64_t t0 = hostUs();
+	for (uint16_t r = 0; r < FILL_REPS; r++)
+		d.clearLights(CLR((uint8_t)r, 1, 2));
+	uint64_t t1 = hostUs();
+	for (uint16_t j = 0; j < FILL_PIX && ok; j++)
+		if (memcmp(c.buf + 4 + j * 4, "\xff\x02\x01", 3) != 0 || c.buf[7 + j * 4] != (uint8_t)(FILL_REPS - 1))
+			ok = fail("clearLights pixel %u is %02x %02x %02x %02x", j, c.buf[4 + j * 4], c.buf[5 + j * 4],
+				c.buf[6 + j * 4], c.buf[7 + j * 4]);
+	printf("\tclearLights %u pixels: %.2f ns/pixel\n", FILL_PIX, (t1 - t0) * 1e3 / ((double)FILL_REPS * FILL_PIX));
+	return ok;
+}
+
+
+/**
+**  64x64 panels wired several ways.  Each canvas pixel is painted with its own index
+**  and the frame read back: every wiring must show each canvas pixel exactly once, and
+**  the plain serpentine must put (x, y) where the wiring says.  Then a frame of
+**  scrolling text is timed: drawing, the gather through the index table, and a whole
+**  showLights.
+**/
+#define MX_SIDE		64
+#define MX_FRAMES	2000
+
+static bool
+chkMatrix()
+{
+	static const uint8_t wirings[] = { MX_SERPENTINE, MX_SERPENTINE | MX_ROT90, MX_COLUMNS | MX_SERPENTINE | MX_FLIPX, MX_ROT270 };
+	static uint8_t hits[MX_SIDE * MX_SIDE];
+	static uint8_t buf[MX_SIDE * MX_SIDE * 4];
+	bool ok = true;
+
+	for (uint8_t k = 0; k < sizeof(wirings); k++)
+	{
+		matrixPat m(MX_SIDE, MX_SIDE, wirings[k]);
+		LTBFill f = { PIX_APA102, 0 };
+
+		for (uint16_t i = 0; i < MX_SIDE * MX_SIDE; i++)
+			m.canvas()[i] = CLR((uint8_t)(i >> 8), (uint8_t)i, 0x55);
+		m.fillRGB(buf, f);
+		memset(hits, 0, sizeof(hits));
+		for (uint16_t i = 0; i < MX_SIDE * MX_SIDE && ok; i++)
+		{
+			uint16_t c = (buf[i * 4 + 3] << 8) | buf[i * 4 + 2];
+			uint8_t y = i / MX_SIDE, x = i % MX_SIDE;
+			if (c >= MX_SIDE * MX_SIDE || hits[c]++)
+				ok = fail("wiring %02x: wire pixel %u shows canvas %u twice or out of range", wirings[k], i, c);
+			else if (wirings[k] == MX_SERPENTINE && c != y * MX_SIDE + ((y & 1) ? MX_SIDE - 1 - x : x))
+				ok = fail("serpentine: wire pixel %u shows canvas %u", i, c);
+		}
+	}
+
+	Capture c;
+	LTBDots d(MX_SIDE * MX_SIDE);
+	matrixPat *m = new matrixPat(MX_SIDE, MX_SIDE, MX_SERPENTINE | MX_ROT90);
+	const char *msg = "LTBDots 64x64";
+	int16_t tw = matrixPat::textWidth(msg);
+	uint64_t draw = 0, gather = 0, show = 0, t0, t1, t2;
+	LTBFill f = { PIX_APA102, 0 };
+
+	d.setOutput(&c);
+	d.addPat(m);
+	for (uint32_t fr = 0; fr < MX_FRAMES; fr++)
+	{
+		t0 = hostUs();
+		m->fill(CLR(0, 0, 8));
+		m->text(msg, MX_SIDE - fr % (MX_SIDE + tw), 28, CLR(255, 200, 0));
+		m->line(0, fr % MX_SIDE, MX_SIDE - 1, MX_SIDE - 1 - fr % MX_SIDE, CLR(0, 80, 255));
+		t1 = hostUs();
+		m->fillRGB(buf, f);
+		sink += buf[fr % sizeof(buf)];
+		t2 = hostUs();
+		d.showLights(true);
+		draw += t1 - t0;
+		gather += t2 - t1;
+		show += hostUs() - t2;
+	}
+	printf("\t%ux%u serpentine rot90: draw %.1f us, gather %.2f ns/pixel, showLights %.1f us per frame\n",
+		MX_SIDE, MX_SIDE, (double)draw / MX_FRAMES, gather * 1e3 / ((double)MX_FRAMES * MX_SIDE * MX_SIDE),
+		(double)show / MX_FRAMES);
+	return ok;
+}
+
+
+/**
+**  The same four patterns shown through the virtual chain and as one StaticScene, in
+**  step off one ManualClock.  Every frame must match byte for byte, with and without
+**  dither; the render time per frame of each path is printed.
+**/
+#define SS_FRAMES	20000
+
+static bool
+chkStatic()
+{
+	static RGB pal[3] = { CLR(255, 0, 0), CLR(0, 255, 0), CLR(0, 0, 255) };
+	static RGB ramp[2] = { CLR(10, 20, 30), CLR(200, 100, 50) };
+	bool ok = true;
+
+	for (uint8_t dith = 0; dith < 2; dith++)
+	{
+		pixPat p(pal, 3, 50, 100);
+		RTPat r(ramp, 150, 100);
+		huePat h(200, 300, 50, 255, 255, 100);
+		noisePat n(pal, 3, 200, 40, 100, 100);
+		Capture ca, cb;
+		ManualClock clk;
+		LTBDots a(600), b(600);
+		uint64_t ta = 0, tb = 0, t0;
+
+		a.setOutput(&ca);
+		a.setClock(&clk);
+		a.addPat(pal, 3, 50);
+		a.addTrans(ramp, 150);
+		a.addHue(200, 300, 50);
+		a.addNoise(pal, 3, 200, 40, 100);
+		b.setOutput(&cb);
+		b.setClock(&clk);
+		b.addPat(new StaticScene<pixPat, RTPat, huePat, noisePat>(&p, &r, &h, &n));
+		a.setDither(dith);
+		b.setDither(dith);
+
+		for (uint32_t fr = 0; fr < SS_FRAMES && ok; fr++)
+		{
+			clk.tick(10);
+			t0 = hostUs();
+			a.renderFrame(true);
+			ta += hostUs() - t0;
+			t0 = hostUs();
+			b.renderFrame(true);
+			tb += hostUs() - t0;
+			a.sendFrame();
+			b.sendFrame();
+			if (ca.len != cb.len || memcmp(ca.buf, cb.buf, ca.len) != 0 || a.getPowerEst() != b.getPowerEst())
+				ok = fail("%s frame %u differs", dith ? "dithered" : "plain", fr);
+		}
+		printf("\t%s 600 pixels, 4 patterns: virtual %.2f us, StaticScene %.2f us per frame\n",
+			dith ? "dithered" : "plain   ", (double)ta / SS_FRAMES, (double)tb / SS_FRAMES);
+	}
+	return ok;
+}
+
+
+/*!
+* \class NativeChase
+*
+* \brief the effect of chaseProg below written as a plain Action, for chkVM
+*
+* \author Kevin Wilson
+* \date
+*/
+#define VM_PIX		100			// past 85, so a rotate moves more than 255 bytes
+#define VM_HUES		30			// pixels painted each frame, the rotates carry them on
+#define VM_TICS		100000
+
+class NativeChase :public Action
+{
+public:
+	NativeChase(Pattern *p) { pat = p; wait = 0; started = false; durTime = 0; durTmr = -1; };
+
+	void			setDimAct(Pattern *pat, uint8_t tgt, ushort dur) {};
+	bool			timerTic(unsigned short deltaT)
+	{
+		if (wait > 0)
+		{
+			wait -= deltaT;
+			if (wait > 0)
+				return false;
+		}
+		if (!started)
+			pat->dimPat(20, 500);
+		started = true;
+		for (uint8_t a = 0; a < VM_HUES; a++)
+			pat->fillPat(hsvRGB(a, 255, 255), a, a);
+		pat->rotateLeft(1);
+		pat->rotateRight(3);
+		wait += 10;
+		return true;
+	};
+	inline uint8_t	actionType() { return SCRIPT; };
+	inline size_t	memSize() { return sizeof(*this); };
+
+protected:
+	int32_t			wait;
+	bool			started;
+};
+
+static const uint8_t chaseProg[] = {
+	'L', 'T', 'B', 'P', LTBP_VERSION, 0, 0, 0,
+	VM_DIM, 20, 0xf4, 0x01,						// to 20% over 500 msec
+	VM_LOOP, 0,
+		VM_SETA, 0,
+		VM_LOOP, VM_HUES,
+			VM_HUEA,
+			VM_PIXA,
+			VM_ADDA, 1,
+		VM_NEXT,
+		VM_ROTL, 1,
+		VM_ROTR, 3,
+		VM_WAIT, 10, 0,
+	VM_NEXT,
+	VM_END
+};
+
+/**
+**  A rainbow chase, dimmed to 20% over its first half second, run as bytecode by LTBVM
+**  and as native code.  The frames must be the same, through the dim, and the VM's time per frame, the effect's own work included, must be
+**  within 2x of native.  Best of three runs each, so a busy host doesn't fail it.
+**/
+static bool
+chkVM()
+{
+	static RGB ca[VM_PIX], cb[VM_PIX];
+	Capture oa, ob;
+	ManualClock clk;
+	LTBDots a(VM_PIX), b(VM_PIX);
+	double tv = 1e30, tn = 1e30;
+	bool ok = true;
+
+	a.setOutput(&oa);
+	b.setOutput(&ob);
+	a.setClock(&clk);
+	b.setClock(&clk);
+	Pattern *pa = a.addPat(ca, VM_PIX, 1);
+	Pattern *pb = b.addPat(cb, VM_PIX, 1);
+	LTBVM *vm = new LTBVM(&a, pa);
+	NativeChase *nat = new NativeChase(pb);
+	if (!vm->load(chaseProg, sizeof(chaseProg)))
+		return fail("program did not load");
+
+	for (uint16_t fr = 0; fr < 200 && ok; fr++)
+	{
+		vm->timerTic(10);
+		nat->timerTic(10);
+		clk.tick(10);
+		a.showLights(true);
+		b.showLights(true);
+		if (oa.len != ob.len || memcmp(oa.buf, ob.buf, oa.len) != 0)
+			ok = fail("frame %u differs", fr);
+	}
+	if (ok && (pa->getOnLvl() != 20 || pb->getOnLvl() != 20))
+		ok = fail("dimmed to %u%% by the VM, %u%% natively, expected 20%%", pa->getOnLvl(), pb->getOnLvl());
+
+	for (uint8_t run = 0; run < 3 && ok; run++)
+	{
+		uint64_t t0 = hostUs();
+		for (uint32_t i = 0; i < VM_TICS; i++)
+			vm->timerTic(10);
+		uint64_t t1 = hostUs();
+		for (uint32_t i = 0; i < VM_TICS; i++)
+			nat->timerTic(10);
+		uint64_t t2 = hostUs();
+		if (t1 - t0 < tv)
+			tv = t1 - t0;
+		if (t2 - t1 < tn)
+			tn = t2 - t1;
+	}
+	printf("\t%u pixel chase: VM %.0f ns, native %.0f ns per frame, %.2fx\n",
+		VM_PIX, tv * 1e3 / VM_TICS, tn * 1e3 / VM_TICS, tv / tn);
+	if (ok && tv > 2 * tn)
+		ok = fail("VM is %.2fx native, more than 2x", tv / tn);
+	delete vm;
+	delete nat;
+	return ok;
+}
+
+
+/*!
+* \class StarLink
+*
+* \brief the master's end of one LoopLink per slave, for chkSync
+*
+* send goes to every slave, as on a bus; recv takes from each in turn.
+*
+* \author Kevin Wilson
+* \date
+*/
+#define SY_NODES	5			// master and 4 slaves
+#define SY_PERIOD	20			// msec per frame
+#define SY_RUNMS	60000		// each phase, before and after the master restarts
+#define SY_SETTLE	10000		// msec of each phase before the spread is measured
+#define SY_FRAMES	(SY_RUNMS / SY_PERIOD)
+
+class StarLink :public SyncLink
+{
+public:
+	StarLink() { next = 0; };
+
+	void			send(const uint8_t *p, uint8_t n) { for (uint8_t i = 0; i < SY_NODES - 1; i++) end[i].send(p, n); };
+	uint8_t			recv(uint8_t *p, uint8_t max)
+	{
+		for (uint8_t i = 0; i < SY_NODES - 1; i++)
+		{
+			uint8_t n = end[next].recv(p, max);
+			next = (next + 1) % (SY_NODES - 1);
+			if (n)
+				return n;
+		}
+		return 0;
+	};
+
+	LoopLink		end[SY_NODES - 1];
+
+protected:
+	uint8_t			next;
+};
+
+typedef struct SyncNode
+{
+	LTBSync		*sync;
+	LoopLink	link;			// slaves only
+	int32_t		ppm;			// crystal error
+	uint32_t	start;			// local micros at true time 0
+	uint64_t	runAt;			// true usec of its next loop
+	uint64_t	lastRun;
+} SyncNode;
+
+static SyncNode	syNode[SY_NODES];
+static uint8_t	syCur;				// node whose clock micros() reads
+static uint64_t	syNow;				// true usec
+
+static unsigned long
+syMicros()
+{
+	SyncNode &n = syNode[syCur];
+	return (uint32_t)(n.start + syNow + (int64_t)syNow * n.ppm / 1000000);
+}
+
+/**
+**  One master and four slaves whose crystals are off by up to 150 ppm, joined by
+**  LoopLinks.  Each node runs its loop every 200-500 usec and now and then stalls for
+**  up to 40 msec, so messages wait in the queues for uneven times both ways and
+**  sometimes overflow them.  Every node latches frames with frameDue, and once the
+**  slaves have settled no frame may be latched more than 1 msec apart across the nodes,
+**  leaving out a node that latched late because it was stalled.  Halfway the master
+**  restarts with a new boot id and clock, and the slaves have to follow it.
+**/
+static bool
+chkSync()
+{
+	static const int32_t ppm[SY_NODES] = { 0, 150, -150, 80, -40 };
+	static uint64_t latch[SY_NODES][SY_FRAMES];
+	StarLink star;
+	uint32_t worst[2] = { 0, 0 }, counted[2] = { 0, 0 }, skipped[2] = { 0, 0 };
+	uint64_t sum[2] = { 0, 0 };
+	bool ok = true;
+
+	srand(49);
+	for (uint8_t i = 0; i < SY_NODES; i++)
+	{
+		SyncNode &n = syNode[i];
+		n.ppm = ppm[i];
+		n.start = (uint32_t)rand() * 7919u;
+		n.runAt = n.lastRun = 0;
+		syCur = i;
+		if (i == 0)
+			n.sync = new LTBSync(&star, true, syMicros);
+		else
+		{
+			LoopLink::connect(star.end[i - 1], n.link);
+			n.sync = new LTBSync(&n.link, false, syMicros);
+		}
+	}
+
+	for (uint8_t phase = 0; phase < 2 && ok; phase++)
+	{
+		uint64_t end = syNow + (uint64_t)SY_RUNMS * 1000;
+
+		if (phase == 1)
+		{
+			syNode[0].start = (uint32_t)rand() * 104729u;	// a new clock as well
+			delete syNode[0].sync;
+			syCur = 0;
+			syNode[0].sync = new LTBSync(&star, true, syMicros);
+			syNode[0].sync->setBootId(2);
+		}
+		syCur = 0;
+		syNode[0].sync->setEpoch(phase + 1, syNode[0].sync->now() + 1000);
+		memset(latch, 0, sizeof(latch));
+
+		while (syNow < end)
+		{
+			uint8_t i = 0;
+			for (uint8_t j = 1; j < SY_NODES; j++)
+				if (syNode[j].runAt < syNode[i].runAt)
+					i = j;
+			SyncNode &n = syNode[i];
+			syNow = n.runAt;
+			syCur = i;
+
+			n.sync->poll();
+			if (n.sync->frameDue(SY_PERIOD) && n.sync->getEpoch() == phase + 1 && n.sync->getFrame() < SY_FRAMES)
+				latch[i][n.sync->getFrame()] = syNow - n.lastRun > 1000 ? 1 : syNow;	// 1: late out of a stall
+			n.lastRun = syNow;
+			n.runAt = syNow + 200 + rand() % 300;
+			if (rand() % 3000 == 0)
+				n.runAt += 5000 + rand() % 35000;
+		}
+
+		for (uint32_t f = SY_SETTLE / SY_PERIOD; f < SY_FRAMES - 100; f++)
+		{
+			uint64_t lo = 0, hi = 0;
+			uint8_t got = 0;
+			for (uint8_t i = 0; i < SY_NODES; i++)
+			{
+				if (latch[i][f] == 1)
+					skipped[phase]++;
+				if (latch[i][f] <= 1)
+					continue;
+				if (got == 0 || latch[i][f] < lo)
+					lo = latch[i][f];
+				if (got == 0 || latch[i][f] > hi)
+					hi = latch[i][f];
+				got++;
+			}
+			if (got < 2)
+				continue;
+			counted[phase]++;
+			sum[phase] += hi - lo;
+			if (hi - lo > worst[phase])
+				worst[phase] = hi - lo;
+			if (hi - lo >= 1000 && ok)
+				ok = fail("%s: frame %u latched %u usec apart", phase ? "after the restart" : "first master",
+					f, (unsigned)(hi - lo));
+		}
+		if (ok && counted[phase] < (SY_FRAMES - 100 - SY_SETTLE / SY_PERIOD) * 9 / 10)
+			ok = fail("%s: only %u frames latched by more than one node", phase ? "after the restart" : "first master",
+				counted[phase]);
+		printf("\t%s: %u frames on %u nodes, latch spread %.0f usec mean, %u worst, %u stalled latches left out\n",
+			phase ? "after restart" : "first master", counted[phase], SY_NODES,
+			counted[phase] ? (double)sum[phase] / counted[phase] : 0.0, worst[phase], skipped[phase]);
+	}
+
+	for (uint8_t i = 0; i < SY_NODES; i++)
+		delete syNode[i].sync;
+	return ok;
+}
+
+
+/**
+**  A sine at 16 kHz sampling, 10 msec of samples pushed a frame, through audioPat at
+**  each FFT size, analysing whole windows a frame and in AUDIO_BUDGET slices.  The loudest
+**  band must be the one holding the sine's bin; the time advance takes per frame is
+**  printed, mean and worst, with the analyses finished per second.
+**/
+#define AU_RATE		16000
+#define AU_FRAMEMS	10
+#define AU_FRAMES	3000
+
+static bool
+chkAudio()
+{
+	static int16_t smp[AU_RATE * AU_FRAMEMS / 1000];
+	bool ok = true;
+
+	for (uint8_t l2 = 6; l2 <= AUDIO_MAXLOG2; l2++)
+		for (uint8_t sliced = 0; sliced < 2; sliced++)
+		{
+			audioPat a(60, l2, 8, NULL, 0, 100);
+			uint16_t bin = (1 << l2) / 8 + 1;
+			uint32_t i = 0;
+			uint64_t total = 0, worst = 0;
+
+			a.setBudget(sliced ? AUDIO_BUDGET : 0);
+			for (uint32_t fr = 0; fr < AU_FRAMES; fr++)
+			{
+				for (uint16_t k = 0; k < sizeof(smp) / sizeof(smp[0]); k++, i++)
+					smp[k] = 8000 * sin(2 * M_PI * bin * (i & ((1 << l2) - 1)) / (1 << l2));
+				a.push(smp, sizeof(smp) / sizeof(smp[0]));
+				uint64_t t0 = hostUs();
+				a.advance(AU_FRAMEMS);
+				uint64_t t = hostUs() - t0;
+				total += t;
+				if (t > worst)
+					worst = t;
+			}
+
+			uint8_t top = 0;
+			for (uint8_t b = 1; b < a.numBands(); b++)
+				if (a.getLevel(b) > a.getLevel(top))
+					top = b;
+			uint16_t hiBin = top + 1 < a.numBands() ? a.bandBin(top + 1) : (1 << l2) / 2 + 1;
+			if (bin < a.bandBin(top) || bin >= hiBin)
+				ok = fail("%u points: sine at bin %u loudest in band %u, bins %u-%u", 1 << l2, bin, top,
+					a.bandBin(top), hiBin - 1);
+			printf("\t%3u point FFT, %s: %.2f us mean, %u worst per frame, %.0f analyses/s\n", 1 << l2,
+				sliced ? "budget 128" : "whole     ", (double)total / AU_FRAMES, (unsigned)worst,
+				a.getWindows() * 1000.0 / ((double)AU_FRAMES * AU_FRAMEMS));
+		}
+	return ok;
+}
+
+/**
+**  onLvl on the wire.  A dimPat to 50% over 100 msec halves every channel, one to 0%
+**  blanks the strip and takes the power estimate down to idle.  An actionBand in
+**  BAND_LVL leaves its pattern dark in silence and lights it for a loud sine.
+**/
+static bool
+chkLevel()
+{
+	static RGB pal[1] = { CLR(200, 100, 50) };
+	static int16_t smp[64];
+	Capture c, e;
+	ManualClock clk;
+	LTBDots d(LV_PIX), s(LV_PIX);
+	audioPat a(LV_PIX, 6, 8, NULL, 0, 100);
+	bool ok = true;
+
+	d.setOutput(&c);
+	d.setClock(&clk);
+	Pattern *p = d.addPat(pal, 1, LV_PIX);
+	d.showLights(true);
+	uint32_t full = d.getPowerEst();
+	p->dimPat(50, 100);
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		clk.tick(10);
+		d.showLights();
+	}
+	if (p->getOnLvl() != 50)
+		ok = fail("dimPat(50, 100): level %u after 400 msec", p->getOnLvl());
+	if (!lvlBytes("dimmed to 50%", c, 100, 50, 25))
+		ok = false;
+	p->dimPat(0, 100);
+	for (uint8_t i = 0; i < 40; i++)
+	{
+		clk.tick(10);
+		d.showLights();
+	}
+	if (!lvlBytes("dimmed to 0%", c, 0, 0, 0))
+		ok = false;
+	if (d.getPowerEst() >= full)
+		ok = fail("power estimate %u mA dark, %u lit", (unsigned)d.getPowerEst(), (unsigned)full);
+
+	s.setOutput(&e);
+	s.setClock(&clk);
+	Pattern *q = s.addPat(pal, 1, LV_PIX);
+	a.setBudget(0);
+	q->addAct(new actionBand(&a, 3, q));			// bins 4-5 of 64, the sine is at 5
+	clk.tick(10);
+	a.advance(10);
+	s.showLights(true);
+	if (!lvlBytes("band in silence", e, 0, 0, 0))
+		ok = false;
+	for (uint16_t i = 0; i < 64; i++)
+		smp[i] = 8000 * sin(2 * M_PI * 5 * i / 64);
+	a.push(smp, 64);
+	clk.tick(10);
+	a.advance(10);
+	s.showLights(true);
+	if (a.getLevel(3) == 0 || e.buf[4 + 3] == 0)
+		ok = fail("loud band: level %u, red %u", a.getLevel(3), e.buf[4 + 3]);
+	return ok;
+}
+
+
+/**
+**  Empty palettes: sparkles and noise with a NULL palette or npal 0 draw from white
+**  instead of reading past the array (run under -fsanitize=address to see it).
+**/
+static bool
+chkPalette()
+{
+	static RGB none[1] = { CLR(0, 0, 0) };
+	Capture c;
+	ManualClock clk;
+	LTBDots d(LV_PIX * 2);
+	bool ok = true;
+
+	d.setOutput(&c);
+	d.setClock(&clk);
+	d.addNoise(none, 0, LV_PIX, 40, 100);
+	Pattern *sp = d.addSparkle(NULL, LV_PIX, 8, NULL, 0);
+	((sparklePat *)sp)->setSpawn(200, 800, 0);
+	uint32_t lit = 0;
+	for (uint16_t f = 0; f < 100; f++)
+	{
+		clk.tick(10);
+		d.showLights();
+		for (uint16_t i = 0; i < LV_PIX * 2; i++)
+		{
+			const uint8_t *q = c.buf + 4 + i * 4;
+			if (q[1] != q[2] || q[2] != q[3])
+				return fail("frame %u: pixel %u is %u %u %u, not grey", f, i, q[3], q[2], q[1]);
+			lit += q[1];
+		}
+	}
+	if (lit == 0)
+		ok = fail("nothing lit");
+	return ok;
+}
+
+static const struct Check
+{
+	const char	*name;
+	bool		(*run)();
+	const char	*what;
+} checks[] = {
+	{ "golden",		chkGolden,		"wire bytes of each pixel format" },
+	{ "spidev",		chkSpidev,		"SpidevOut file fallback against the golden bytes" },
+	{ "editcol",	chkEditCol,		"editCol writes reach the wire through a private copy" },
+	{ "trailer",	chkTrailer,		"no surplus leader or end frame bytes, 1 to 65535 pixels" },
+	{ "scene",		chkScene,		"loadScene onLvl and dim actions on the wire" },
+	{ "dither",		chkDither,		"dithered fader fraction dropped once the colors are written" },
+	{ "skip",		chkSkip,		"unchanged frames held back until the keepalive" },
+	{ "palette",	chkPalette,		"sparkles and noise with an empty palette" },
+	{ "ingest",		chkIngest,		"E1.31 through loopback UDP into frames, latency and throughput" },
+	{ "manual",		chkManual,		"100k ManualClock frames render the same every run" },
+	{ "fill",		chkFill,		"short period, long repeat fills against a per pixel loop" },
+	{ "matrix",		chkMatrix,		"64x64 panel wiring tables and frame time" },
+	{ "static",		chkStatic,		"StaticScene against the virtual pattern chain" },
+	{ "vm",			chkVM,			"bytecode effect against the same effect in native code" },
+	{ "sync",		chkSync,		"frame latch spread of skewed, jittery nodes, and a master restart" },
+	{ "audio",		chkAudio,		"FFT band analysis time per frame" },
+	{ "level",		chkLevel,		"pattern brightness from dims and audio bands on the wire" },
+};
+
+int
+main(int argc, char **argv)
+{
+	int failed = 0;
+
+	for (size_t i = 0; i < sizeof(checks) / sizeof(checks[0]); i++)
+	{
+		bool want = argc < 2;
+		for (int a = 1; a < argc; a++)
+			if (strcmp(argv[a], checks[i].name) == 0)
+				want = true;
+		if (!want)
+			continue;
+
+		printf("%-12s %s\n", checks[i].name, checks[i].what);
+		bool ok = checks[i].run();
+		printf("%-12s %s\n", checks[i].name, ok ? "ok" : "FAIL");
+		if (!ok)
+			failed++;
+	}
+	return failed;
+}
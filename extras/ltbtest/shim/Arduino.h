@@ -0,0 +1,51 @@
+// Arduino.h
+//
+// Just enough of the Arduino core for the library to build on a host, for ltbtest.
+// millis/micros run off the host's monotonic clock, Serial goes nowhere and random
+// is the C library's.  The definitions are in ltbtest.cpp.
+
+#ifndef _ARDUINO_h
+#define _ARDUINO_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define HEX 16
+#define DEC 10
+
+#define PROGMEM
+#define pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define pgm_read_word(p)	(*(const uint16_t *)(p))
+
+unsigned long	millis();
+unsigned long	micros();
+long			random(long n);
+long			random(long lo, long hi);
+void			delay(unsigned long ms);
+
+class HardwareSerial
+{
+public:
+	template <class T> void	print(T v, int base = DEC) {};
+	template <class T> void	println(T v, int base = DEC) {};
+	void					println() {};
+};
+
+extern HardwareSerial Serial;
+
+class Stream
+{
+public:
+	virtual ~Stream() {};
+
+	virtual int		available() { return 0; };
+	virtual int		read() { return -1; };
+	virtual size_t	write(uint8_t b) { return 1; };
+	size_t			write(const uint8_t *p, size_t n) { for (size_t i = 0; i < n; i++) write(p[i]); return n; };
+};
+
+#endif
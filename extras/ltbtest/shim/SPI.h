@@ -0,0 +1,19 @@
+// SPI.h
+//
+// Host stand-in for the Arduino SPI library, for ltbtest.  Bytes go nowhere; the
+// tests capture frames with their own DotsOut.
+
+#ifndef _SPI_h
+#define _SPI_h
+
+#include "Arduino.h"
+
+class SPIClass
+{
+public:
+	inline uint8_t	transfer(uint8_t b) { return b; };
+};
+
+extern SPIClass SPI;
+
+#endif